@@ -86,26 +86,15 @@ timer_elapsed (int64_t then)
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
-
-#
 void
 timer_sleep (int64_t ticks) 
 {
   int64_t start = timer_ticks ();
 
   ASSERT (intr_get_level () == INTR_ON);
-
-  // added by kwak
-   int64_t *ptrs=&start, *ptrtick=&ticks;
-#define MACRO_BLOCK_THREAD_UNTIL_TICK(start, ticks) block_thread_until_tick(*(int64_t*)(start) + *(int64_t*)(ticks)) 
-  MACRO_BLOCK_THREAD_UNTIL_TICK(ptrs, ptrtick);
-  /*
-  Previous code that causes busy wating
-
-  while (timer_elapsed (start) < ticks)
-    thread_yield ();
-  */ 
-#undef MACRO_BLOCK_THREAD_UNTIL_TICK*/
+  if (ticks <= 0)
+    return;
+  block_thread_until_tick (start + ticks);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -185,13 +174,8 @@ timer_interrupt (struct intr_frame *args UNUSED)
   ticks++;
   thread_tick ();
 
-  // added by Kwak
-  // todo: discription
-  if(first_sleep_tick <= ticks)
-  {
-    unblock_thread_after_tick(ticks);
-  }
-  //
+  if (first_sleep_tick <= ticks)
+    unblock_thread_after_tick (ticks);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
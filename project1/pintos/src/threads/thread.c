@@ -28,9 +28,13 @@ static struct list ready_list;
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-// added by Hisu
-// todo: discription
-static struct list blocked_list;
+/* Threads sleeping in timer_sleep(), ordered by wake-up tick. */
+static struct heap sleep_heap;
+
+/* Wake-up tick of the thread at the top of sleep_heap, or
+   INT64_MAX if no thread is sleeping.  Lets the timer interrupt
+   handler skip unblock_thread_after_tick() on most ticks. */
+int64_t first_sleep_tick = INT64_MAX;
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -74,6 +78,9 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static bool sleep_less (const struct heap_elem *, const struct heap_elem *,
+                        void *);
+static void update_first_sleep_tick (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -96,7 +103,7 @@ thread_init (void)
   lock_init (&tid_lock);
   list_init (&ready_list);
   list_init (&all_list);
-  list_init (&blocked_list);
+  heap_init (&sleep_heap, sleep_less, NULL);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -233,31 +240,24 @@ thread_block (void)
   schedule ();
 }
 
-// added by KWAK, Choi
-// parameter:
-// description:
-
-#define SET_INTR(x) (intr_set_level(x),x=!x?INTR_ON:INTR_OFF)
+/* Puts the current thread to sleep until the timer reaches
+   TICKS.  The thread goes on the sleep heap, ordered by wake-up
+   tick, and is woken by unblock_thread_after_tick(). */
 void
 block_thread_until_tick (int64_t ticks)
 {
-  struct thread *crrnt_thrd;
-
-  enum intr_level previous_level = intr_disable();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-  crrnt_thrd = thread_current();
-  ASSERT((uintptr_t)crrnt_thrd ^ (uintptr_t)idle_thread);
+  ASSERT (cur != idle_thread);
 
-  // added by Choi
-  /* description : designate sleep_tick in each thread and
-                 set to first_sleep_tick */  
-  set_first_sleep_tick(crrnt_thrd->sleep_tick = ticks);
-  
-  list_push_back(&blocked_list, &crrnt_thrd->elem);
-  thread_block();
-  SET_INTR(previous_level);
+  old_level = intr_disable ();
+  cur->sleep_tick = ticks;
+  heap_push (&sleep_heap, &cur->sleep_elem);
+  update_first_sleep_tick ();
+  thread_block ();
+  intr_set_level (old_level);
 }
-#undef SET_INTR
 
 
 /* Transitions a blocked thread T to the ready-to-run state.
@@ -282,40 +282,23 @@ thread_unblock (struct thread *t)
   intr_set_level (old_level);
 }
 
-// added by KWAK
-// parameter:
-// description:
+/* Wakes up every sleeping thread whose wake-up tick is at or
+   before TICKS.  Called by the timer interrupt handler.  Only
+   the threads it wakes, plus the one left at the top of the
+   sleep heap, are looked at. */
 void
 unblock_thread_after_tick (int64_t ticks)
 {
-#define MOVE(elem) list_next(elem)
-#define UNBLOCK_THREAD(e, pntr, tick) \
-  if ((tick)<list_entry(e, struct thread, elem)->sleep_tick) { \
-    e = MOVE(e); \
-  } else { \
-    e = list_remove(&pntr->elem); \
-    thread_unblock(pntr); \
-  }
-#define SET_TICK_CONDITION(tick, cond) \
-  if(cond) { \
-    set_first_sleep_tick(tick); \
-  }
-
-  struct list_elem *elem_pntr;
-  elem_pntr = list_begin(&blocked_list);
-
-  while(elem_pntr != list_end(&blocked_list))
-  {
-    struct thread* tmp_thrd_pntr = list_entry(elem_pntr, 
-                                              struct thread, 
-                                              elem);
-
-    SET_TICK_CONDITION(tmp_thrd_pntr->sleep_tick, ticks < tmp_thrd_pntr->sleep_tick);
-    UNBLOCK_THREAD(elem_pntr, tmp_thrd_pntr, ticks);
-  }
-#undef MOVE
-#undef UNBLOCK_THREAD
-#undef SET_TICK_CONDITION
+  while (!heap_empty (&sleep_heap))
+    {
+      struct thread *t = heap_entry (heap_top (&sleep_heap),
+                                     struct thread, sleep_elem);
+      if (t->sleep_tick > ticks)
+        break;
+      heap_pop (&sleep_heap);
+      thread_unblock (t);
+    }
+  update_first_sleep_tick ();
 }
 
 /* Returns the name of the running thread. */
@@ -568,21 +551,28 @@ next_thread_to_run (void)
 }
 
 
-// added by Hisu
-// parameter: 
-// description: 
-void
-set_first_sleep_tick (int64_t ticks)
+/* Returns true if thread A wakes up before thread B. */
+static bool
+sleep_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
 {
-  if(ticks < first_sleep_tick)
-  {
-    first_sleep_tick = ticks;
-  }
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
+
+  return a->sleep_tick < b->sleep_tick;
+}
+
+/* Sets first_sleep_tick to the wake-up tick of the thread at
+   the top of the sleep heap, or to INT64_MAX if no thread is
+   sleeping. */
+static void
+update_first_sleep_tick (void)
+{
+  if (heap_empty (&sleep_heap))
+    first_sleep_tick = INT64_MAX;
   else
-  {
-    first_sleep_tick = first_sleep_tick;
-  }
-  
+    first_sleep_tick = heap_entry (heap_top (&sleep_heap), struct thread,
+                                   sleep_elem)->sleep_tick;
 }
 
 
@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 
@@ -101,9 +102,9 @@ struct thread
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
 
-    // added by Hisu
-    // todo: description
-    int64_t sleep_tick;
+    /* Owned by thread.c, for timer_sleep(). */
+    int64_t sleep_tick;                 /* Tick to wake up at. */
+    struct heap_elem sleep_elem;        /* Element in sleep heap. */
   };
 
 /* If false (default), use round-robin scheduler.
@@ -147,9 +148,6 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-// added by Hisu
-// todo: description
-static int64_t first_sleep_tick;
-void set_first_sleep_tick (int64_t ticks);
+extern int64_t first_sleep_tick;
 
 #endif /* threads/thread.h */
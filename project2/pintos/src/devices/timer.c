@@ -92,6 +92,8 @@ timer_sleep (int64_t ticks)
   int64_t start = timer_ticks ();
 
   ASSERT (intr_get_level () == INTR_ON);
+  if (ticks <= 0)
+    return;
   block_thread_until_tick(start + ticks);
 }
 
@@ -172,17 +174,10 @@ timer_interrupt (struct intr_frame *args UNUSED)
   ticks++;
   thread_tick ();
   //Advanced Scheduler : Kwak//
-  if (thread_mlfqs) {
-    up_mlfqs_recent_cpu ();
-    if (ticks & 3 == 0) { // 3(decimal)=011(2)
-      recalc_mlfqs_pri ();
-      if (ticks % TIMER_FREQ == 0) {
-        recalc_mlfqs_recent_cpu ();
-        calc_mlfqs_load_avg ();
-      }
-    }
-  }
-  unblock_thread_after_tick(ticks);
+  if (thread_mlfqs)
+    mlfqs_tick (ticks);
+  if (first_sleep_tick <= ticks)
+    unblock_thread_after_tick (ticks);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -68,9 +68,7 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      /*** Project2 : Kwak ***/
-      //list_push_back (&sema->waiters, &thread_current ()->elem);
-      list_insert_ordered (&sema->waiters, &thread_current ()->elem, &elem_compare_priority, NULL);
+      list_push_back (&sema->waiters, &thread_current ()->elem);
       thread_block ();
     }
   sema->value--;
@@ -115,11 +113,15 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  //Kwak, Choi//
+  /* Wake the highest-priority waiter, or the one that has waited
+     longest among equals.  Waiters' priorities may have changed
+     through donation since they went to sleep, so look them all
+     over now instead of keeping the list sorted. */
   if (!list_empty (&sema->waiters)) {
-    list_sort (&sema->waiters, &elem_compare_priority, NULL);
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    struct list_elem *e = list_min (&sema->waiters,
+                                    &elem_compare_priority, NULL);
+    list_remove (e);
+    thread_unblock (list_entry (e, struct thread, elem));
   }
   sema->value++;
   /* check higher priority thread in ready list : Kwak, Choi */
@@ -388,10 +390,10 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)){
-    /* Kwak */
-    list_sort (&cond->waiters, &sema_compare_priority, NULL);
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    struct list_elem *e = list_min (&cond->waiters,
+                                    &sema_compare_priority, NULL);
+    list_remove (e);
+    sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
   }
 }
 
@@ -4,6 +4,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/fixed_point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
@@ -30,9 +31,30 @@
 //Advanced Scheduler: Kwak //
 int load_avg;
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Number of threads whose recent_cpu is decayed per timer tick.
+   Once a second every thread's recent_cpu decays, but doing
+   them all in one timer interrupt would make it take time
+   proportional to the number of threads.  Instead the threads
+   are decayed a batch at a time over the following ticks. */
+#define DECAY_BATCH 16
+
+/* Next thread in all_list whose recent_cpu still has to be
+   decayed in the current pass, or the end of all_list if there
+   is none, and the decay coefficient for the pass. */
+static struct list_elem *decay_cursor;
+static int decay_coeff;
+
+/* Number of distinct priorities. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+
+/* Lists of processes in THREAD_READY state, that is, processes
+   that are ready to run but not actually running.  There is one
+   FIFO queue per priority.  Bit P of ready_bits is set if and
+   only if ready_queues[P] is nonempty, so the highest-priority
+   ready thread can be found without looking at the queues. */
+static struct list ready_queues[PRI_CNT];
+static uint32_t ready_bits[PRI_CNT / 32];
+static size_t ready_cnt;        /* Number of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -80,9 +102,21 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
-
-//alarm-clock: Kwak//
-static struct list block_list;
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void change_priority (struct thread *, int priority);
+static bool sleep_less (const struct heap_elem *, const struct heap_elem *,
+                        void *);
+static void update_first_sleep_tick (void);
+
+/* Threads sleeping in timer_sleep(), ordered by wake-up tick. */
+static struct heap sleep_heap;
+
+/* Wake-up tick of the thread at the top of sleep_heap, or
+   INT64_MAX if no thread is sleeping.  Lets the timer interrupt
+   handler skip unblock_thread_after_tick() on most ticks. */
+int64_t first_sleep_tick = INT64_MAX;
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -101,14 +135,18 @@ static struct list block_list;
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i < PRI_CNT; i++)
+    list_init (&ready_queues[i]);
   list_init (&all_list);
+  decay_cursor = list_end (&all_list);
 
   /*** Alarm Clock ***/
-  list_init (&block_list);
+  heap_init (&sleep_heap, sleep_less, NULL);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -268,10 +306,7 @@ thread_unblock (struct thread *t)
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
 
-  /* Replace list_push_back to list_insert_ordered : Kwak */
-  //list_push_back (&ready_list, &t->elem);
-  list_insert_ordered(&ready_list, &t->elem, &elem_compare_priority, NULL);
-
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -324,6 +359,8 @@ thread_exit (void)
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (decay_cursor == &thread_current ()->allelem)
+    decay_cursor = list_next (decay_cursor);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -342,11 +379,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-  {
-    /* replace list_push_back to list_insert_ordered : Kwak */
-    //list_push_back (&ready_list, &cur->elem);
-    list_insert_ordered(&ready_list, &cur->elem, &elem_compare_priority, NULL);
-  }
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -560,10 +593,74 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  struct thread *t;
+
+  if (ready_cnt == 0)
     return idle_thread;
+
+  t = list_entry (list_front (&ready_queues[ready_max_priority ()]),
+                  struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Adds T to the back of the ready queue for its priority. */
+static void
+ready_push (struct thread *t) 
+{
+  int pri = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (0 <= pri && pri < PRI_CNT);
+
+  list_push_back (&ready_queues[pri], &t->elem);
+  ready_bits[pri / 32] |= 1u << (pri % 32);
+  ready_cnt++;
+}
+
+/* Removes T from its ready queue. */
+static void
+ready_remove (struct thread *t) 
+{
+  int pri = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[pri]))
+    ready_bits[pri / 32] &= ~(1u << (pri % 32));
+  ready_cnt--;
+}
+
+/* Returns the highest priority of any ready thread, or
+   PRI_MIN - 1 if no thread is ready. */
+static int
+ready_max_priority (void) 
+{
+  int i;
+
+  for (i = PRI_CNT / 32 - 1; i >= 0; i--)
+    if (ready_bits[i] != 0)
+      return PRI_MIN + i * 32 + (31 - __builtin_clz (ready_bits[i]));
+  return PRI_MIN - 1;
+}
+
+/* Sets T's priority to PRIORITY.  If T is ready to run, moves
+   it to the back of the ready queue for its new priority. */
+static void
+change_priority (struct thread *t, int priority) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (t->status == THREAD_READY && t->priority != priority)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
+  intr_set_level (old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -651,68 +748,66 @@ allocate_tid (void)
 
 
 /*** Project1 ***/
-#define SET_INTR(x) (intr_set_level(x),x=!x?INTR_ON:INTR_OFF)
+/* Puts the current thread to sleep until the timer reaches
+   TICKS.  The thread goes on the sleep heap, ordered by wake-up
+   tick, and is woken by unblock_thread_after_tick(). */
 void
 block_thread_until_tick (int64_t ticks)
 {
-  struct thread *crrnt_thrd;
-
-  enum intr_level previous_level = intr_disable();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-  crrnt_thrd = thread_current();
-  ASSERT((uintptr_t)crrnt_thrd ^ (uintptr_t)idle_thread);
+  ASSERT (cur != idle_thread);
 
-  // added by Choi
-  /* description : designate sleep_tick in each thread and
-                 set to first_sleep_tick */  
-  set_first_sleep_tick(crrnt_thrd->sleep_tick = ticks);
-  
-  list_push_back(&block_list, &crrnt_thrd->elem);
-  thread_block();
-  SET_INTR(previous_level);
+  old_level = intr_disable ();
+  cur->sleep_tick = ticks;
+  heap_push (&sleep_heap, &cur->sleep_elem);
+  update_first_sleep_tick ();
+  thread_block ();
+  intr_set_level (old_level);
 }
-#undef SET_INTR
 
+/* Wakes up every sleeping thread whose wake-up tick is at or
+   before TICKS.  Called by the timer interrupt handler.  Only
+   the threads it wakes, plus the one left at the top of the
+   sleep heap, are looked at. */
 void
 unblock_thread_after_tick (int64_t ticks)
 {
-#define MOVE(elem) list_next(elem)
-#define UNBLOCK_THREAD(e, pntr, tick) \
-  if ((tick)<list_entry(e, struct thread, elem)->sleep_tick) { \
-    e = MOVE(e); \
-  } else { \
-    e = list_remove(&pntr->elem); \
-    thread_unblock(pntr); \
-  }
-#define SET_TICK_CONDITION(tick, cond) \
-  if(cond) { \
-    set_first_sleep_tick(tick); \
-  }
-
-  struct list_elem *elem_pntr;
-  elem_pntr = list_begin(&block_list);
+  while (!heap_empty (&sleep_heap))
+    {
+      struct thread *t = heap_entry (heap_top (&sleep_heap),
+                                     struct thread, sleep_elem);
+      if (t->sleep_tick > ticks)
+        break;
+      heap_pop (&sleep_heap);
+      thread_unblock (t);
+    }
+  update_first_sleep_tick ();
+}
 
-  while(elem_pntr != list_end(&block_list))
-  {
-    struct thread* tmp_thrd_pntr = list_entry(elem_pntr, 
-                                              struct thread, 
-                                              elem);
+/* Returns true if thread A wakes up before thread B. */
+static bool
+sleep_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
 
-    SET_TICK_CONDITION(tmp_thrd_pntr->sleep_tick, ticks < tmp_thrd_pntr->sleep_tick);
-    UNBLOCK_THREAD(elem_pntr, tmp_thrd_pntr, ticks);
-  }
-#undef MOVE
-#undef UNBLOCK_THREAD
-#undef SET_TICK_CONDITION
+  return a->sleep_tick < b->sleep_tick;
 }
 
-void
-set_first_sleep_tick (int64_t ticks){
-  if(ticks < first_sleep_tick){
-    first_sleep_tick = ticks;
-  }else{
-    first_sleep_tick = first_sleep_tick;
-  }
+/* Sets first_sleep_tick to the wake-up tick of the thread at
+   the top of the sleep heap, or to INT64_MAX if no thread is
+   sleeping. */
+static void
+update_first_sleep_tick (void)
+{
+  if (heap_empty (&sleep_heap))
+    first_sleep_tick = INT64_MAX;
+  else
+    first_sleep_tick = heap_entry (heap_top (&sleep_heap), struct thread,
+                                   sleep_elem)->sleep_tick;
 }
 
 /** Project2 : Kwak **/
@@ -725,12 +820,16 @@ elem_compare_priority (const struct list_elem *a, const struct list_elem *b, voi
   return a_priority > b_priority;
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, yields once the
+   handler returns instead. */
 void
 check_high_priority (void){
-  if (!list_empty(&ready_list)){ 
-    if(elem_compare_priority (list_begin(&ready_list), &thread_current ()->elem, NULL)){
+  if (ready_max_priority () > thread_current ()->priority){
+    if (intr_context ())
+      intr_yield_on_return ();
+    else
       thread_yield ();
-    }
   }
 }
 
@@ -761,7 +860,7 @@ donate_priority (void)
     if (holder->priority >= cur->priority)
       return;
 
-    holder->priority = cur->priority;
+    change_priority (holder, cur->priority);
     cur = holder;
   }
   /* Choi */
@@ -798,52 +897,85 @@ renew_priority (void)
 //Advanced Scheduler//
 /* caculate priority for mlfqs : Kwak */
 void calc_mlfqs_pri (struct thread *t){
+  int priority;
+
   if(t==idle_thread) return;
-  t->priority = fp_to_int (add_mixed (div_mixed(t->recent_cpu, -4), PRI_MAX - t->nice * 2));
+  priority = fp_to_int (add_mixed (div_mixed(t->recent_cpu, -4), PRI_MAX - t->nice * 2));
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  change_priority (t, priority);
 }
 
 /* calc recent_cpu of thread : Kwak */
+/* Decays T's recent_cpu by the coefficient for the current
+   second and recomputes its priority. */
 void calc_mlfqs_recent_cpu (struct thread *t){
   if(t==idle_thread) return;
-  t->recent_cpu = add_mixed (mult_fp (div_fp (mult_mixed (load_avg, 2), 
-                            add_mixed (mult_mixed (load_avg, 2), 1)), 
-                                      t->recent_cpu), 
-                                      t->nice);
+  t->recent_cpu = add_mixed (mult_fp (decay_coeff, t->recent_cpu), t->nice);
+  calc_mlfqs_pri (t);
 }
 /* calc load_avg : Kwak */
 /* Also calc during the idle_thread is running */
 void calc_mlfqs_load_avg (void){
   int ready_threads;
   if(thread_current()==idle_thread){
-    ready_threads=list_size(&ready_list);
+    ready_threads=ready_cnt;
   }else{
-    ready_threads=list_size(&ready_list)+1;
+    ready_threads=ready_cnt+1;
   }
   load_avg = add_fp (mult_fp (div_fp (int_to_fp (59), int_to_fp (60)), load_avg), 
                      mult_mixed (div_fp (int_to_fp (1), int_to_fp (60)), ready_threads));
 }
 
-/* Kwak */
-void up_mlfqs_recent_cpu(void){
-  if(thread_current () != idle_thread){
-    thread_current ()->recent_cpu = add_mixed (thread_current ()->recent_cpu, 1);
-  }
+/* Decays the recent_cpu of up to CNT more threads in the
+   current pass over all_list. */
+static void
+decay_mlfqs_recent_cpu (size_t cnt)
+{
+  for (; cnt > 0 && decay_cursor != list_end (&all_list); cnt--)
+    {
+      struct thread *t = list_entry (decay_cursor, struct thread, allelem);
+      decay_cursor = list_next (decay_cursor);
+      calc_mlfqs_recent_cpu (t);
+    }
 }
 
-void recalc_mlfqs_recent_cpu(void){
-  struct list_elem *e;
-  for (e=list_begin (&all_list); e!=list_end (&all_list); e=list_next (e)) {
-    struct thread *t = list_entry (e, struct thread, allelem);
-    calc_mlfqs_recent_cpu(t);
-  }
-}
+/* Advanced scheduler work for timer tick TICKS, called by the
+   timer interrupt handler.  Costs O(1) per tick apart from the
+   bounded decay batch.
 
-void recalc_mlfqs_pri(void){
-  struct list_elem *e;
-  for (e=list_begin (&all_list); e!=list_end (&all_list); e=list_next (e)) {
-    struct thread *t = list_entry (e, struct thread, allelem);
-    calc_mlfqs_pri(t);
-  }
+   Only the running thread's recent_cpu grows between seconds,
+   so every fourth tick only its priority needs recomputing.
+   Once a second, load_avg is updated and a pass begins that
+   decays every thread's recent_cpu, DECAY_BATCH threads per
+   tick.  If a pass is still unfinished when the next second
+   starts, which takes more than DECAY_BATCH * TIMER_FREQ
+   threads, it is finished first. */
+void
+mlfqs_tick (int64_t ticks)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_context ());
+
+  if (cur != idle_thread)
+    cur->recent_cpu = add_mixed (cur->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      decay_mlfqs_recent_cpu (SIZE_MAX);
+      calc_mlfqs_load_avg ();
+      decay_coeff = div_fp (mult_mixed (load_avg, 2),
+                            add_mixed (mult_mixed (load_avg, 2), 1));
+      decay_cursor = list_begin (&all_list);
+    }
+  decay_mlfqs_recent_cpu (DECAY_BATCH);
+
+  if (ticks % 4 == 0)
+    calc_mlfqs_pri (cur);
+  check_high_priority ();
 }
 
 /* Offset of `stack' member within `struct thread'.
@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 
@@ -90,6 +91,7 @@ struct thread
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
     int64_t sleep_tick;		/* store wake tick */
+    struct heap_elem sleep_elem;        /* Element in sleep heap. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
@@ -152,13 +154,12 @@ int thread_get_load_avg (void);
 /*** Project1 and 2***/
 void block_thread_until_tick(int64_t ticks);
 void unblock_thread_after_tick(int64_t ticks);
-static int64_t first_sleep_tick;
-void set_first_sleep_tick (int64_t ticks);
+extern int64_t first_sleep_tick;
 
 bool elem_compare_priority(const struct list_elem *a, 
                           const struct list_elem *b, 
                           void *aux UNUSED);
-void check_high_priority();
+void check_high_priority (void);
 void renew_priority (void);
 void elem_remove_lock_holder (struct lock *lock);
 void donate_priority (void);
@@ -168,9 +169,7 @@ void donate_priority (void);
 void calc_mlfqs_pri (struct thread *t);
 void calc_mlfqs_recent_cpu (struct thread *t);
 void calc_mlfqs_load_avg (void);
-void up_mlfqs_recent_cpu (void);
-void recalc_mlfqs_recent_cpu (void);
-void recalc_mlfqs_pri (void);
+void mlfqs_tick (int64_t ticks);
 
 
 #endif /* threads/thread.h */
\ No newline at end of file
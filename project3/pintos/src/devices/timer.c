@@ -24,7 +24,19 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Threads sleeping in timer_sleep(), ordered by wake-up tick. */
+static struct heap sleep_heap;
+
+/* Wake-up tick of the thread at the top of sleep_heap, or
+   INT64_MAX if no thread is sleeping.  Lets the timer interrupt
+   handler skip looking at the heap on most ticks. */
+static int64_t first_sleep_tick = INT64_MAX;
+
 static intr_handler_func timer_interrupt;
+static bool sleep_less (const struct heap_elem *, const struct heap_elem *,
+                        void *);
+static void update_first_sleep_tick (void);
+static void wake_sleepers (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -36,6 +48,7 @@ void
 timer_init (void) 
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  heap_init (&sleep_heap, sleep_less, NULL);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -85,15 +98,24 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.  The thread blocks on the sleep heap until the
+   timer interrupt handler wakes it. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->sleep_tick = timer_ticks () + ticks;
+  heap_push (&sleep_heap, &cur->sleep_elem);
+  update_first_sleep_tick ();
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -172,6 +194,50 @@ timer_interrupt (struct intr_frame *args UNUSED)
 {
   ticks++;
   thread_tick ();
+  if (first_sleep_tick <= ticks)
+    wake_sleepers ();
+}
+
+/* Returns true if thread A wakes up before thread B. */
+static bool
+sleep_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
+
+  return a->sleep_tick < b->sleep_tick;
+}
+
+/* Sets first_sleep_tick to the wake-up tick of the thread at
+   the top of the sleep heap, or to INT64_MAX if no thread is
+   sleeping. */
+static void
+update_first_sleep_tick (void)
+{
+  if (heap_empty (&sleep_heap))
+    first_sleep_tick = INT64_MAX;
+  else
+    first_sleep_tick = heap_entry (heap_top (&sleep_heap), struct thread,
+                                   sleep_elem)->sleep_tick;
+}
+
+/* Wakes up every sleeping thread whose wake-up tick has been
+   reached.  Only the threads it wakes, plus the one left at the
+   top of the sleep heap, are looked at. */
+static void
+wake_sleepers (void)
+{
+  while (!heap_empty (&sleep_heap))
+    {
+      struct thread *t = heap_entry (heap_top (&sleep_heap),
+                                     struct thread, sleep_elem);
+      if (t->sleep_tick > ticks)
+        break;
+      heap_pop (&sleep_heap);
+      thread_unblock (t);
+    }
+  update_first_sleep_tick ();
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
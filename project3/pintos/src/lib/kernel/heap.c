@@ -0,0 +1,130 @@
+/* Priority queue.
+
+   See heap.h for basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+/* Upper bound on the combined length of the rightmost paths of
+   two heaps, each of which has fewer than 2**32 elements. */
+#define MAX_MERGE_DEPTH 64
+
+static int rank (const struct heap_elem *);
+static struct heap_elem *merge (struct heap *, struct heap_elem *,
+                                struct heap_elem *);
+
+/* Initializes heap H as an empty heap that compares elements
+   using LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) 
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into heap H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) 
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->left = e->right = NULL;
+  e->rank = 1;
+  h->root = merge (h, h->root, e);
+  h->elem_cnt++;
+}
+
+/* Returns the smallest element in H without removing it.
+   If several elements are equally small, returns any one of
+   them.  H must not be empty. */
+struct heap_elem *
+heap_top (const struct heap *h) 
+{
+  ASSERT (!heap_empty (h));
+  return h->root;
+}
+
+/* Removes and returns the smallest element in H, the same one
+   that heap_top() would return.  H must not be empty. */
+struct heap_elem *
+heap_pop (struct heap *h) 
+{
+  struct heap_elem *top = heap_top (h);
+
+  h->root = merge (h, top->left, top->right);
+  h->elem_cnt--;
+  return top;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) 
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty (const struct heap *h) 
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns the length of the rightmost path from E, which is 0
+   if E is a null pointer. */
+static int
+rank (const struct heap_elem *e) 
+{
+  return e != NULL ? e->rank : 0;
+}
+
+/* Merges the heaps rooted at A and B, either of which may be a
+   null pointer, and returns the root of the result.
+
+   Walks down the rightmost paths of both heaps, always linking
+   in the smaller of the two current elements, then retraces the
+   path to swap children where needed to keep the heap leftist.
+   Both paths are short, so this needs no recursion. */
+static struct heap_elem *
+merge (struct heap *h, struct heap_elem *a, struct heap_elem *b) 
+{
+  struct heap_elem *path[MAX_MERGE_DEPTH];
+  struct heap_elem *root = NULL;
+  struct heap_elem **link = &root;
+  size_t depth = 0;
+
+  while (a != NULL && b != NULL) 
+    {
+      if (h->less (b, a, h->aux)) 
+        {
+          struct heap_elem *t = a;
+          a = b;
+          b = t;
+        }
+      ASSERT (depth < MAX_MERGE_DEPTH);
+      path[depth++] = a;
+      *link = a;
+      link = &a->right;
+      a = a->right;
+    }
+  *link = a != NULL ? a : b;
+
+  while (depth-- > 0) 
+    {
+      struct heap_elem *e = path[depth];
+      if (rank (e->left) < rank (e->right)) 
+        {
+          struct heap_elem *t = e->left;
+          e->left = e->right;
+          e->right = t;
+        }
+      e->rank = rank (e->right) + 1;
+    }
+  return root;
+}
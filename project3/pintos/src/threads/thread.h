@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 /* Kwak */
@@ -111,6 +112,10 @@ struct thread
     struct semaphore load_lock;
 #endif
 
+    /* Owned by devices/timer.c. */
+    int64_t sleep_tick;                 /* Tick to wake up at. */
+    struct heap_elem sleep_elem;        /* Element in sleep heap. */
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -19,6 +19,8 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long cache_cnt[BLOCK_CACHE_EVENT_CNT];
+                                        /* Cache events, by type. */
   };
 
 /* List of all block devices. */
@@ -139,6 +141,59 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Devices that can do so transfer all of them with a
+   single command; others fall back to one block_read() per
+   sector. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer_, block_sector_t cnt)
+{
+  uint8_t *buffer = buffer_;
+  block_sector_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->read_multiple != NULL)
+    {
+      block->ops->read_multiple (block->aux, sector, buffer, cnt);
+      block->read_cnt += cnt;
+    }
+  else
+    for (i = 0; i < cnt; i++)
+      block_read (block, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged all of them.
+   Devices that can do so transfer all of them with a single
+   command; others fall back to one block_write() per sector. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer_, block_sector_t cnt)
+{
+  const uint8_t *buffer = buffer_;
+  block_sector_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multiple != NULL)
+    {
+      block->ops->write_multiple (block->aux, sector, buffer, cnt);
+      block->write_cnt += cnt;
+    }
+  else
+    for (i = 0; i < cnt; i++)
+      block_write (block, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -171,13 +226,31 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
+          unsigned long long *cnt = block->cache_cnt;
+
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (cnt[BLOCK_CACHE_HIT] + cnt[BLOCK_CACHE_MISS] > 0)
+            printf ("%s (%s): cache %llu hits, %llu misses, "
+                    "%llu prefetched, %llu prefetches used\n",
+                    block->name, block_type_name (block->type),
+                    cnt[BLOCK_CACHE_HIT], cnt[BLOCK_CACHE_MISS],
+                    cnt[BLOCK_CACHE_PREFETCH],
+                    cnt[BLOCK_CACHE_PREFETCH_USED]);
         }
     }
 }
 
+/* Records one cache EVENT for BLOCK, to be reported by
+   block_print_stats(). */
+void
+block_count_cache_event (struct block *block, enum block_cache_event event)
+{
+  ASSERT (event < BLOCK_CACHE_EVENT_CNT);
+  block->cache_cnt[event]++;
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -200,6 +273,7 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  memset (block->cache_cnt, 0, sizeof block->cache_cnt);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
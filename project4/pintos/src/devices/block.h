@@ -53,11 +53,28 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, void *,
+                          block_sector_t cnt);
+void block_write_multiple (struct block *, block_sector_t, const void *,
+                           block_sector_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
 /* Statistics. */
 void block_print_stats (void);
+
+/* Events counted on behalf of a cache layered over a block
+   device, such as the file system buffer cache. */
+enum block_cache_event
+  {
+    BLOCK_CACHE_HIT,             /* Sector found in cache. */
+    BLOCK_CACHE_MISS,            /* Sector had to be read in. */
+    BLOCK_CACHE_PREFETCH,        /* Sector read in ahead of use. */
+    BLOCK_CACHE_PREFETCH_USED,   /* Prefetched sector later hit. */
+    BLOCK_CACHE_EVENT_CNT        /* Number of event types. */
+  };
+
+void block_count_cache_event (struct block *, enum block_cache_event);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,6 +82,12 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors at once. */
+    void (*read_multiple) (void *aux, block_sector_t, void *buffer,
+                           block_sector_t cnt);
+    void (*write_multiple) (void *aux, block_sector_t, const void *buffer,
+                            block_sector_t cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -0,0 +1,386 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Timer ticks between two passes of the write-behind thread. */
+#define WRITE_BEHIND_TICKS (5 * TIMER_FREQ)
+
+/* Maximum number of pending read-ahead requests. */
+#define READ_AHEAD_QUEUE_SIZE 32
+
+/* A sector held in the buffer cache. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Sector number, if in use. */
+    bool in_use;                        /* Does this entry hold a sector? */
+    bool dirty;                         /* Modified since last write-back? */
+    bool accessed;                      /* Referenced since last clock pass? */
+    bool prefetched;                    /* Read ahead, not yet used? */
+    struct lock lock;                   /* Guards the fields above and DATA. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+/* The cache itself.  Entries are reused in clock order. */
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects the sector-to-entry mapping and the clock hand.
+   An entry's SECTOR and IN_USE only change while both this lock
+   and the entry's own lock are held. */
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Sectors waiting to be read ahead, as a circular queue. */
+static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE_SIZE];
+static size_t read_ahead_head;          /* Index of oldest request. */
+static size_t read_ahead_cnt;           /* Number of pending requests. */
+static struct lock read_ahead_lock;     /* Protects the queue. */
+static struct condition read_ahead_cond; /* Signaled on new requests. */
+
+/* Set by cache_done() to stop the cache's threads. */
+static bool cache_stopped;
+
+static struct cache_entry *cache_lookup (block_sector_t);
+static struct cache_entry *cache_evict (void);
+static struct cache_entry *cache_get (block_sector_t, bool need_read,
+                                      bool prefetch);
+static thread_func cache_write_behind NO_RETURN;
+static thread_func cache_read_ahead_daemon NO_RETURN;
+static void cache_thread_park (void) NO_RETURN;
+
+/* Initializes the buffer cache and starts the threads that
+   periodically write dirty sectors back to disk and that read
+   sectors ahead of sequential readers. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].in_use = false;
+      cache[i].dirty = false;
+      cache[i].accessed = false;
+      cache[i].prefetched = false;
+      lock_init (&cache[i].lock);
+    }
+  clock_hand = 0;
+  cache_stopped = false;
+
+  read_ahead_head = read_ahead_cnt = 0;
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_cond);
+
+  thread_create ("write-behind", PRI_DEFAULT, cache_write_behind, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, cache_read_ahead_daemon, NULL);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into sector SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Copies SIZE bytes starting at byte offset OFS within sector
+   SECTOR into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true, false);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Copies SIZE bytes from BUFFER into sector SECTOR, starting at
+   byte offset OFS within the sector.  The sector reaches the
+   disk on eviction or on the next flush. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  /* A write that covers the whole sector need not read it first. */
+  e = cache_get (sector, ofs > 0 || size < BLOCK_SECTOR_SIZE, false);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&e->lock);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache.
+   Does not wait for the read.  The request is dropped if the
+   queue is full or already holds SECTOR. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  size_t i;
+
+  lock_acquire (&read_ahead_lock);
+  for (i = 0; i < read_ahead_cnt; i++)
+    if (read_ahead_queue[(read_ahead_head + i) % READ_AHEAD_QUEUE_SIZE]
+        == sector)
+      break;
+  if (i == read_ahead_cnt && read_ahead_cnt < READ_AHEAD_QUEUE_SIZE
+      && !cache_stopped)
+    {
+      read_ahead_queue[(read_ahead_head + read_ahead_cnt++)
+                       % READ_AHEAD_QUEUE_SIZE] = sector;
+      cond_signal (&read_ahead_cond, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Writes every dirty sector in the cache back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&e->lock);
+      if (e->in_use && e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+        }
+      lock_release (&e->lock);
+    }
+}
+
+/* Shuts down the buffer cache, writing any unwritten data to
+   disk.  The write-behind and read-ahead threads stop doing work
+   the next time they wake up. */
+void
+cache_done (void)
+{
+  lock_acquire (&read_ahead_lock);
+  cache_stopped = true;
+  read_ahead_cnt = 0;
+  cond_signal (&read_ahead_cond, &read_ahead_lock);
+  lock_release (&read_ahead_lock);
+
+  cache_flush ();
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+   is not cached.  Must be called with cache_lock held. */
+static struct cache_entry *
+cache_lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].in_use && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an entry to reuse with the clock algorithm and returns
+   it locked.  The entry may still hold a dirty sector, which the
+   caller must write back.  Locked entries are skipped, including
+   ones the current thread holds: a page fault taken while copying
+   to or from an entry can evict a page through the file system.  Returns a null pointer if no entry could
+   be claimed within two sweeps.  Must be called with cache_lock
+   held. */
+static struct cache_entry *
+cache_evict (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (lock_held_by_current_thread (&e->lock)
+          || !lock_try_acquire (&e->lock))
+        continue;
+      if (!e->in_use)
+        return e;
+      if (e->accessed)
+        {
+          e->accessed = false;
+          lock_release (&e->lock);
+          continue;
+        }
+      return e;
+    }
+  return NULL;
+}
+
+/* Returns the entry for SECTOR with its lock held, bringing the
+   sector into the cache if necessary.  If NEED_READ is false the
+   caller is going to overwrite the whole sector, so the old
+   contents are not read from disk on a miss.  PREFETCH is true
+   for reads on behalf of the read-ahead thread, which are
+   counted separately from demand hits and misses. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool need_read, bool prefetch)
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+
+      lock_acquire (&cache_lock);
+      e = cache_lookup (sector);
+      if (e != NULL)
+        {
+          /* Hit.  Don't wait for the entry with cache_lock held:
+             its holder may be in the middle of disk I/O. */
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          if (e->in_use && e->sector == sector)
+            {
+              e->accessed = true;
+              if (!prefetch)
+                {
+                  block_count_cache_event (fs_device, BLOCK_CACHE_HIT);
+                  if (e->prefetched)
+                    block_count_cache_event (fs_device,
+                                             BLOCK_CACHE_PREFETCH_USED);
+                  e->prefetched = false;
+                }
+              return e;
+            }
+
+          /* Reused for another sector while we waited. */
+          lock_release (&e->lock);
+          continue;
+        }
+
+      e = cache_evict ();
+      if (e == NULL)
+        {
+          /* Every entry is busy.  Let their holders finish. */
+          lock_release (&cache_lock);
+          thread_yield ();
+          continue;
+        }
+      if (e->in_use && e->dirty)
+        {
+          /* Write back before remapping, so that a thread which
+             misses on the old sector cannot read stale data.
+             Only E's lock is held meanwhile: threads after the
+             old sector wait on it, and other lookups go ahead. */
+          lock_release (&cache_lock);
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+          lock_acquire (&cache_lock);
+          if (cache_lookup (sector) != NULL)
+            {
+              /* Someone else brought SECTOR in meanwhile.  E
+                 keeps its old, now clean, sector. */
+              lock_release (&cache_lock);
+              lock_release (&e->lock);
+              continue;
+            }
+        }
+      e->sector = sector;
+      e->in_use = true;
+      e->dirty = false;
+      e->accessed = true;
+      e->prefetched = prefetch;
+      lock_release (&cache_lock);
+
+      block_count_cache_event (fs_device, prefetch ? BLOCK_CACHE_PREFETCH
+                                                   : BLOCK_CACHE_MISS);
+
+      /* Threads looking for SECTOR now find E and wait on its
+         lock until the read completes. */
+      if (need_read)
+        block_read (fs_device, sector, e->data);
+      else
+        memset (e->data, 0, BLOCK_SECTOR_SIZE);
+      return e;
+    }
+}
+
+/* Write-behind thread.  Periodically flushes dirty sectors so
+   that a crash loses at most a few seconds of writes. */
+static void
+cache_write_behind (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_TICKS);
+      if (cache_stopped)
+        cache_thread_park ();
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread.  Takes sectors queued by cache_read_ahead()
+   and loads those that are not already cached, so that a
+   sequential reader finds them there on its next read. */
+static void
+cache_read_ahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      struct cache_entry *e;
+      bool cached;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0 && !cache_stopped)
+        cond_wait (&read_ahead_cond, &read_ahead_lock);
+      if (cache_stopped)
+        {
+          lock_release (&read_ahead_lock);
+          cache_thread_park ();
+        }
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      lock_acquire (&cache_lock);
+      cached = cache_lookup (sector) != NULL;
+      lock_release (&cache_lock);
+
+      if (!cached)
+        {
+          e = cache_get (sector, true, true);
+          lock_release (&e->lock);
+        }
+    }
+}
+
+/* Blocks a cache thread for good after cache_done().  Kernel
+   threads can't exit through thread_exit(), which expects a
+   user process. */
+static void
+cache_thread_park (void)
+{
+  struct semaphore never;
+
+  sema_init (&never, 0);
+  sema_down (&never);
+  NOT_REACHED ();
+}
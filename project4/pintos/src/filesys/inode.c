@@ -3,23 +3,61 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of CNT contiguous sectors on disk, starting at sector
+   START, that holds the file's data sectors FIRST through
+   FIRST + CNT - 1. */
+struct extent
+  {
+    uint32_t first;                     /* First file sector covered. */
+    block_sector_t start;               /* First disk sector. */
+    uint32_t cnt;                       /* Number of sectors. */
+  };
+
+/* Number of extents stored in the on-disk inode itself. */
+#define INLINE_EXTENTS 41
+
+/* Number of extents per indirect extent block. */
+#define EXTENTS_PER_BLOCK (BLOCK_SECTOR_SIZE / sizeof (struct extent))
+
+/* Number of indirect extent blocks that the indirect table in
+   sector INDIRECT can point to. */
+#define INDIRECT_BLOCKS (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Maximum number of extents in a single file. */
+#define MAX_EXTENTS (INLINE_EXTENTS + INDIRECT_BLOCKS * EXTENTS_PER_BLOCK)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Extents are sorted by file sector and cover the file's data
+   sectors without gaps.  The first INLINE_EXTENTS live here.
+   Any further ones live in indirect extent blocks, whose sector
+   numbers are listed in the indirect table in sector INDIRECT. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Number of extents in use. */
+    block_sector_t indirect;            /* Indirect table, or 0 if none. */
+    struct extent extents[INLINE_EXTENTS]; /* Inline extents. */
+    uint32_t unused[1];                 /* Not used. */
   };
 
+/* Fails to compile unless struct inode_disk is exactly one
+   sector in size. */
+typedef char inode_disk_size_check[sizeof (struct inode_disk)
+                                   == BLOCK_SECTOR_SIZE ? 1 : -1];
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -28,15 +66,27 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   ELEM, OPEN_CNT, REMOVED and LOADING are protected by
+   open_inodes_lock.
+   RW protects the rest: reads and writes that stay within the
+   file hold it for reading, since the buffer cache serializes
+   access to each data sector, and writes that extend the file
+   hold it for writing. */
 struct inode 
   {
     struct list_elem elem;              /* Element in inode list. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loading;                       /* Still being read by inode_open()? */
+    struct rwlock rw;                   /* Guards the members below. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct extent *extents;             /* All DATA.EXTENT_CNT extents. */
+    size_t extent_cap;                  /* Capacity of EXTENTS. */
+    struct lock lock;                   /* See inode_lock(). */
   };
 
 /* Returns the block device sector that contains byte offset POS
@@ -48,20 +98,286 @@ byte_to_sector (const struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    {
+      /* Binary search for the last extent whose first file
+         sector is at or before POS's. */
+      uint32_t idx = pos / BLOCK_SECTOR_SIZE;
+      size_t lo = 0, hi = inode->data.extent_cnt;
+
+      while (hi - lo > 1)
+        {
+          size_t mid = (lo + hi) / 2;
+          if (inode->extents[mid].first <= idx)
+            lo = mid;
+          else
+            hi = mid;
+        }
+
+      ASSERT (lo < inode->data.extent_cnt);
+      ASSERT (idx - inode->extents[lo].first < inode->extents[lo].cnt);
+      return inode->extents[lo].start + (idx - inode->extents[lo].first);
+    }
   else
     return -1;
 }
 
+/* Returns the number of data sectors allocated to INODE. */
+static size_t
+inode_sectors (const struct inode *inode)
+{
+  const struct extent *last;
+
+  if (inode->data.extent_cnt == 0)
+    return 0;
+  last = &inode->extents[inode->data.extent_cnt - 1];
+  return last->first + last->cnt;
+}
+
+/* Returns the sector of indirect extent block BLOCK of INODE.
+   If CREATE is true, allocates the indirect table and the block
+   as needed; otherwise they must already exist.
+   Returns 0 if allocation fails. */
+static block_sector_t
+get_extent_block (struct inode *inode, size_t block, bool create)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  block_sector_t sector = 0;
+
+  ASSERT (block < INDIRECT_BLOCKS);
+
+  if (inode->data.indirect == 0)
+    {
+      if (!create || !free_map_allocate (1, &inode->data.indirect))
+        return 0;
+      cache_write (inode->data.indirect, zeros);
+    }
+
+  cache_read_at (inode->data.indirect, &sector,
+                 block * sizeof sector, sizeof sector);
+  if (sector == 0 && create && free_map_allocate (1, &sector))
+    cache_write_at (inode->data.indirect, &sector,
+                    block * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Stores extent IDX of INODE in its on-disk location.  Inline
+   extents are only updated in INODE->DATA; the caller must write
+   the inode itself back.  Returns false if an indirect extent
+   block is needed but cannot be allocated. */
+static bool
+store_extent (struct inode *inode, size_t idx)
+{
+  block_sector_t sector;
+
+  if (idx < INLINE_EXTENTS)
+    {
+      inode->data.extents[idx] = inode->extents[idx];
+      return true;
+    }
+
+  idx -= INLINE_EXTENTS;
+  sector = get_extent_block (inode, idx / EXTENTS_PER_BLOCK, true);
+  if (sector == 0)
+    return false;
+  cache_write_at (sector, &inode->extents[idx + INLINE_EXTENTS],
+                  idx % EXTENTS_PER_BLOCK * sizeof (struct extent),
+                  sizeof (struct extent));
+  return true;
+}
+
+/* Adds CNT sectors starting at disk sector START to the end of
+   INODE's data, merging with the last extent if they are
+   contiguous with it.  Returns true if successful, false if
+   memory or disk allocation fails. */
+static bool
+append_extent (struct inode *inode, block_sector_t start, size_t cnt)
+{
+  size_t n = inode->data.extent_cnt;
+  struct extent *last = n > 0 ? &inode->extents[n - 1] : NULL;
+
+  if (last != NULL && last->start + last->cnt == start)
+    {
+      last->cnt += cnt;
+      if (store_extent (inode, n - 1))
+        return true;
+      last->cnt -= cnt;
+      return false;
+    }
+
+  if (n >= MAX_EXTENTS)
+    return false;
+  if (n >= inode->extent_cap)
+    {
+      size_t cap = inode->extent_cap * 2;
+      struct extent *extents = realloc (inode->extents,
+                                        cap * sizeof *extents);
+      if (extents == NULL)
+        return false;
+      inode->extents = extents;
+      inode->extent_cap = cap;
+    }
+
+  inode->extents[n].first = inode_sectors (inode);
+  inode->extents[n].start = start;
+  inode->extents[n].cnt = cnt;
+  if (!store_extent (inode, n))
+    return false;
+  inode->data.extent_cnt++;
+  return true;
+}
+
+/* Undoes a partial inode_grow() of INODE, which had CNT extents,
+   the last of them LAST_CNT sectors long, before it began: releases
+   the sectors added since, along with any indirect extent blocks
+   they needed, and writes the inode back. */
+static void
+inode_truncate (struct inode *inode, size_t cnt, uint32_t last_cnt)
+{
+  size_t blocks = (cnt > INLINE_EXTENTS
+                   ? DIV_ROUND_UP (cnt - INLINE_EXTENTS, EXTENTS_PER_BLOCK)
+                   : 0);
+  size_t i;
+
+  for (i = cnt; i < inode->data.extent_cnt; i++)
+    free_map_release (inode->extents[i].start, inode->extents[i].cnt);
+  inode->data.extent_cnt = cnt;
+  if (cnt > 0 && inode->extents[cnt - 1].cnt > last_cnt)
+    {
+      struct extent *last = &inode->extents[cnt - 1];
+
+      free_map_release (last->start + last_cnt, last->cnt - last_cnt);
+      last->cnt = last_cnt;
+      store_extent (inode, cnt - 1);
+    }
+
+  if (inode->data.indirect != 0)
+    {
+      for (i = blocks; i < INDIRECT_BLOCKS; i++)
+        {
+          block_sector_t sector = get_extent_block (inode, i, false);
+          if (sector != 0)
+            {
+              free_map_release (sector, 1);
+              sector = 0;
+              cache_write_at (inode->data.indirect, &sector,
+                              i * sizeof sector, sizeof sector);
+            }
+        }
+      if (blocks == 0)
+        {
+          free_map_release (inode->data.indirect, 1);
+          inode->data.indirect = 0;
+        }
+    }
+  cache_write (inode->sector, &inode->data);
+}
+
+/* Extends INODE so that it is LENGTH bytes long, zero-filling the
+   new data, and writes the inode back to disk.  New sectors are
+   placed directly after the file's last sector where possible,
+   and otherwise in runs as long as the free map allows, so that
+   files written sequentially stay mostly contiguous.
+   Returns true if successful.  On failure INODE is left as it
+   was, with any sectors added so far released again.
+   The caller must hold INODE's RW lock for writing. */
+static bool
+inode_grow (struct inode *inode, off_t length)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  size_t need = bytes_to_sectors (length);
+  size_t old_cnt = inode->data.extent_cnt;
+  uint32_t old_last = old_cnt > 0 ? inode->extents[old_cnt - 1].cnt : 0;
+
+  ASSERT (rwlock_held_for_write (&inode->rw));
+
+  while (inode_sectors (inode) < need)
+    {
+      size_t cnt = need - inode_sectors (inode);
+      size_t n = inode->data.extent_cnt;
+      block_sector_t start = 0;
+      size_t i;
+
+      /* Try to continue the last extent in place. */
+      if (n > 0)
+        {
+          start = inode->extents[n - 1].start + inode->extents[n - 1].cnt;
+          cnt = free_map_allocate_at (start, cnt);
+        }
+      else
+        cnt = 0;
+
+      /* Otherwise take the longest run we can get elsewhere. */
+      if (cnt == 0)
+        {
+          for (cnt = need - inode_sectors (inode); cnt > 0; cnt /= 2)
+            if (free_map_allocate (cnt, &start))
+              break;
+          if (cnt == 0)
+            goto fail;
+        }
+
+      if (!append_extent (inode, start, cnt))
+        {
+          free_map_release (start, cnt);
+          goto fail;
+        }
+      for (i = 0; i < cnt; i++)
+        cache_write (start + i, zeros);
+    }
+
+  if (length > inode->data.length)
+    inode->data.length = length;
+  cache_write (inode->sector, &inode->data);
+  return true;
+
+ fail:
+  inode_truncate (inode, old_cnt, old_last);
+  return false;
+}
+
+/* Releases all of INODE's data sectors and indirect extent
+   blocks back to the free map. */
+static void
+inode_deallocate (struct inode *inode)
+{
+  size_t i;
+
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    free_map_release (inode->extents[i].start, inode->extents[i].cnt);
+
+  if (inode->data.indirect != 0)
+    {
+      for (i = 0; i < INDIRECT_BLOCKS; i++)
+        {
+          block_sector_t sector = get_extent_block (inode, i, false);
+          if (sector != 0)
+            free_map_release (sector, 1);
+        }
+      free_map_release (inode->data.indirect, 1);
+    }
+}
+
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Protects open_inodes and the open counts of the inodes in it. */
+static struct lock open_inodes_lock;
+
+/* Signaled when an inode on open_inodes finishes loading. */
+static struct condition inode_loaded;
+
+/* Cache of struct inodes. */
+static struct kmem_cache inode_cache;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
+  kmem_cache_init (&inode_cache, "inode", sizeof (struct inode));
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -73,34 +389,30 @@ bool
 inode_create (block_sector_t sector, off_t length)
 {
   struct inode_disk *disk_inode = NULL;
+  struct inode *inode;
   bool success = false;
 
   ASSERT (length >= 0);
 
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
-
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
+      /* Write an empty inode, then grow it to LENGTH. */
+      disk_inode->length = 0;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      cache_write (sector, disk_inode);
       free (disk_inode);
+
+      inode = inode_open (sector);
+      if (inode != NULL)
+        {
+          rwlock_acquire_write (&inode->rw);
+          success = inode_grow (inode, length);
+          if (!success)
+            inode_deallocate (inode);
+          rwlock_release_write (&inode->rw);
+          inode_close (inode);
+        }
     }
   return success;
 }
@@ -113,23 +425,39 @@ inode_open (block_sector_t sector)
 {
   struct list_elem *e;
   struct inode *inode;
-
-  /* Check whether this inode is already open. */
+  size_t i;
+
+  /* Check whether this inode is already open.  A new inode goes
+     on the list before it is read, marked as loading, so that two
+     threads opening the same sector get the same inode but the
+     read itself does not hold up other opens and closes. */
+  lock_acquire (&open_inodes_lock);
+ retry:
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          if (inode->loading)
+            {
+              /* Look again afterward, since loading may fail. */
+              cond_wait (&inode_loaded, &open_inodes_lock);
+              goto retry;
+            }
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
@@ -137,7 +465,45 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->loading = true;
+  rwlock_init (&inode->rw);
+  lock_init (&inode->lock);
+  lock_release (&open_inodes_lock);
+
+  cache_read (sector, &inode->data);
+  inode->extent_cap = INLINE_EXTENTS;
+  while (inode->extent_cap < inode->data.extent_cnt)
+    inode->extent_cap *= 2;
+  inode->extents = malloc (inode->extent_cap * sizeof *inode->extents);
+  if (inode->extents == NULL)
+    {
+      lock_acquire (&open_inodes_lock);
+      list_remove (&inode->elem);
+      cond_broadcast (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      kmem_cache_free (&inode_cache, inode);
+      return NULL;
+    }
+
+  /* Gather the inline and indirect extents into one array. */
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    if (i < INLINE_EXTENTS)
+      inode->extents[i] = inode->data.extents[i];
+    else
+      {
+        size_t j = i - INLINE_EXTENTS;
+        block_sector_t block = get_extent_block (inode,
+                                                 j / EXTENTS_PER_BLOCK,
+                                                 false);
+        cache_read_at (block, &inode->extents[i],
+                       j % EXTENTS_PER_BLOCK * sizeof (struct extent),
+                       sizeof (struct extent));
+      }
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +512,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,25 +533,31 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    list_remove (&inode->elem);
+  lock_release (&open_inodes_lock);
+
+  /* Release resources if this was the last opener.  No other
+     thread can find INODE any more. */
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          inode_deallocate (inode);
         }
 
-      free (inode); 
+      free (inode->extents);
+      kmem_cache_free (&inode_cache, inode);
     }
 }
 
@@ -191,7 +567,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,8 +580,8 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rw);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -220,50 +598,58 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Copy the chunk out of the buffer cache. */
+      cache_read_at (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rw);
 
   return bytes_read;
 }
 
+/* Asks the buffer cache to read ahead up to CNT sectors of
+   INODE's data, starting with the sector that holds byte OFFSET.
+   Sectors past end of file are not requested. */
+void
+inode_read_ahead (struct inode *inode, off_t offset, size_t cnt)
+{
+  off_t length = inode_length (inode);
+
+  offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE);
+  rwlock_acquire_read (&inode->rw);
+  for (; cnt > 0 && offset < length; cnt--, offset += BLOCK_SECTOR_SIZE)
+    cache_read_ahead (byte_to_sector (inode, offset));
+  rwlock_release_read (&inode->rw);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.
+   A write past end of file extends the inode first; if that
+   fails, nothing is written. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  /* Only a write that extends the file needs the inode to itself.
+     A file never shrinks, so a write that fits now still fits
+     once the lock is held. */
+  bool grow = size > 0 && offset + size > inode_length (inode);
+
+  if (grow)
+    rwlock_acquire_write (&inode->rw);
+  else
+    rwlock_acquire_read (&inode->rw);
+
+  if (inode->deny_write_cnt || (grow && !inode_grow (inode, offset + size)))
+    size = 0;
 
   while (size > 0) 
     {
@@ -281,38 +667,21 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* Copy the chunk into the buffer cache.  The cache reads
+         the rest of the sector from disk first if needed. */
+      cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                      chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (grow)
+    rwlock_release_write (&inode->rw);
+  else
+    rwlock_release_read (&inode->rw);
 
   return bytes_written;
 }
@@ -322,8 +691,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +703,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +716,21 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Acquires INODE's lock.  The directory code holds it while it
+   searches or updates the directory stored in INODE, so that
+   each directory operation is atomic with respect to others on
+   the same directory.  It does not exclude inode_read_at() or
+   inode_write_at() callers. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
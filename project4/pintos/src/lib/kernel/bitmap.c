@@ -21,13 +21,25 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Bitmaps with at least this many bits keep summary bitmaps. */
+#define SUMMARY_MIN_BITS (ELEM_BITS * ELEM_BITS)
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Large bitmaps also keep two summary bitmaps with one bit per
+   element of BITS: a bit in FULL is set if the element's bits
+   are all true, and a bit in EMPTY is set if they are all false.
+   Searches use them to skip over whole runs of elements that
+   cannot contain the value being looked for.  Small bitmaps set
+   FULL and EMPTY to null pointers. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Elements whose bits are all true. */
+    elem_type *empty;   /* Elements whose bits are all false. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +80,124 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the number of bytes required for each of the summary
+   bitmaps of a bitmap with BIT_CNT bits. */
+static inline size_t
+summary_byte_cnt (size_t bit_cnt)
+{
+  return bit_cnt >= SUMMARY_MIN_BITS ? byte_cnt (elem_cnt (bit_cnt)) : 0;
+}
+
+/* Points B's summary bitmaps into the storage that follows its
+   bits, or sets them to null pointers if B is too small to need
+   them. */
+static void
+summary_init (struct bitmap *b)
+{
+  if (summary_byte_cnt (b->bit_cnt) > 0)
+    {
+      b->full = b->bits + elem_cnt (b->bit_cnt);
+      b->empty = b->full + elem_cnt (elem_cnt (b->bit_cnt));
+    }
+  else
+    b->full = b->empty = NULL;
+}
+
+/* Brings the summary bits for element ELEM of B up to date with
+   the element's contents. */
+static void
+summary_update (struct bitmap *b, size_t elem)
+{
+  if (b->full != NULL)
+    {
+      elem_type used = (elem == elem_cnt (b->bit_cnt) - 1
+                        ? last_mask (b) : (elem_type) -1);
+      elem_type bits = b->bits[elem] & used;
+      size_t idx = elem_idx (elem);
+      elem_type mask = bit_mask (elem);
+
+      if (bits == used)
+        b->full[idx] |= mask;
+      else
+        b->full[idx] &= ~mask;
+      if (bits == 0)
+        b->empty[idx] |= mask;
+      else
+        b->empty[idx] &= ~mask;
+    }
+}
+
+#ifdef FILESYS
+/* Recomputes all of B's summary bits. */
+static void
+summary_rebuild (struct bitmap *b)
+{
+  size_t i;
+
+  if (b->full != NULL)
+    for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+      summary_update (b, i);
+}
+#endif
+
+/* Returns the index of the first of the CNT elements of BITS, at
+   or after element START, that has a bit set to VALUE, or CNT if
+   there is none.  Skips elements with no such bit a whole
+   element at a time. */
+static size_t
+elem_find (const elem_type *bits, size_t cnt, size_t start, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t elem = elem_idx (start);
+  elem_type e;
+
+  if (start >= cnt * ELEM_BITS)
+    return cnt * ELEM_BITS;
+
+  /* Ignore bits before START in the first element. */
+  e = (bits[elem] ^ flip) & ~(bit_mask (start) - 1);
+  while (e == 0)
+    {
+      if (++elem >= cnt)
+        return cnt * ELEM_BITS;
+      e = bits[elem] ^ flip;
+    }
+  return elem * ELEM_BITS + __builtin_ctzl (e);
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value)
+{
+  size_t cnt = elem_cnt (b->bit_cnt);
+  size_t idx;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  if (b->full == NULL)
+    idx = elem_find (b->bits, cnt, start, value);
+  else
+    {
+      /* Search START's own element, then let the summary pick
+         the next element that has a match, that is, one whose
+         bits are not all !VALUE. */
+      const elem_type *skip = value ? b->empty : b->full;
+      size_t elem = elem_idx (start);
+
+      idx = elem_find (b->bits, elem + 1, start, value);
+      if (idx >= (elem + 1) * ELEM_BITS)
+        {
+          elem = elem_find (skip, elem_cnt (cnt), elem + 1, false);
+          idx = (elem < cnt
+                 ? elem_find (b->bits, cnt, elem * ELEM_BITS, value)
+                 : cnt * ELEM_BITS);
+        }
+    }
+  return idx < b->bit_cnt ? idx : b->bit_cnt;
+}
 
 /* Creation and destruction. */
 
@@ -82,9 +212,10 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->bits = malloc (byte_cnt (bit_cnt) + 2 * summary_byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
+          summary_init (b);
           bitmap_set_all (b, false);
           return b;
         }
@@ -105,6 +236,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  summary_init (b);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +246,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return (sizeof (struct bitmap) + byte_cnt (bit_cnt)
+          + 2 * summary_byte_cnt (bit_cnt));
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -164,6 +297,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -177,6 +311,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  summary_update (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -192,6 +327,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  summary_update (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -214,18 +350,27 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Elements that lie wholly inside the range are set with a
+   single store each. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t i = start, end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (; i < end && i % ELEM_BITS != 0; i++)
+    bitmap_set (b, i, value);
+  for (; end - i >= ELEM_BITS; i += ELEM_BITS)
+    {
+      b->bits[elem_idx (i)] = value ? (elem_type) -1 : 0;
+      summary_update (b, elem_idx (i));
+    }
+  for (; i < end; i++)
+    bitmap_set (b, i, value);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -251,16 +396,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -292,7 +432,11 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Works run by run: finds the next bit set to VALUE, then the
+   end of the run it starts, rather than testing every candidate
+   start position bit by bit. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
@@ -302,10 +446,22 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      if (cnt == 0)
+        return start;
+      for (;;)
+        {
+          size_t end;
+
+          i = find_next (b, i, value);
+          if (i > last)
+            break;
+          end = find_next (b, i, !value);
+          if (end - i >= cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -347,6 +503,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      summary_rebuild (b);
     }
   return success;
 }
@@ -1,5 +1,20 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Blocks shorter than this many bytes are handled a byte at a
+   time by memcpy(), memset() and memcmp(), since setting up a
+   string instruction costs more than it saves. */
+#define WORD_OP_MIN 16
+
+/* Returns the number of bytes from P to the next 4-byte
+   boundary. */
+static inline size_t
+align_bytes (const void *p)
+{
+  return -(uintptr_t) p & (sizeof (uint32_t) - 1);
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,6 +27,23 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  if (size >= WORD_OP_MIN)
+    {
+      /* Copy bytes up to a word boundary in DST, then whole
+         words with REP MOVSL, leaving the tail for the loop
+         below. */
+      size_t head = align_bytes (dst);
+      size_t words;
+
+      size -= head;
+      while (head-- > 0)
+        *dst++ = *src++;
+      words = size / sizeof (uint32_t);
+      size %= sizeof (uint32_t);
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words)
+                    : : "memory");
+    }
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -58,6 +90,25 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  if (size >= WORD_OP_MIN)
+    {
+      /* Skip equal words with REPE CMPSL.  If a word differs,
+         back up to it and let the loop below find the byte. */
+      size_t words = size / sizeof (uint32_t);
+      bool differ;
+
+      asm volatile ("repe cmpsl; setne %3"
+                    : "+S" (a), "+D" (b), "+c" (words), "=q" (differ)
+                    : : "cc", "memory");
+      if (differ)
+        {
+          a -= sizeof (uint32_t);
+          b -= sizeof (uint32_t);
+          size = sizeof (uint32_t);
+        }
+      else
+        size %= sizeof (uint32_t);
+    }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -281,7 +332,24 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= WORD_OP_MIN)
+    {
+      /* Fill bytes up to a word boundary, then whole words with
+         REP STOSL, leaving the tail for the loop below. */
+      size_t head = align_bytes (dst);
+      uint32_t word = (unsigned char) value * 0x01010101u;
+      size_t words;
+
+      size -= head;
+      while (head-- > 0)
+        *dst++ = value;
+      words = size / sizeof (uint32_t);
+      size %= sizeof (uint32_t);
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words)
+                    : "a" (word) : "memory");
+    }
   while (size-- > 0)
     *dst++ = value;
 
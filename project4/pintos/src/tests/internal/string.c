@@ -0,0 +1,188 @@
+/* Benchmark for memcpy(), memset() and memcmp() in lib/string.c.
+
+   Times each function against a copy of the byte-at-a-time
+   version that lib/string.c used to have, over page-sized
+   blocks at a few alignments, and reports the cost of each in
+   CPU cycles per KB.  Also checks that both versions produce
+   the same results.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/synch.h"
+#include "threads/test.h"
+
+/* Bytes per block operation. */
+#define BLOCK_SIZE 4096
+
+/* Times each operation is repeated per measurement. */
+#define REPEAT 64
+
+static uint8_t src[BLOCK_SIZE + 8], dst[BLOCK_SIZE + 8];
+
+static void *byte_memcpy (void *, const void *, size_t);
+static void *byte_memset (void *, int, size_t);
+static int byte_memcmp (const void *, const void *, size_t);
+static uint64_t rdtsc (void);
+static void report (const char *name, int ofs, uint64_t before,
+                    uint64_t after);
+
+/* The functions being timed.  They are called through pointers
+   so that the compiler can neither inline them nor substitute
+   its own built-in versions for the lib/string.c ones. */
+static void *(*volatile old_memcpy) (void *, const void *, size_t)
+  = byte_memcpy;
+static void *(*volatile new_memcpy) (void *, const void *, size_t) = memcpy;
+static void *(*volatile old_memset) (void *, int, size_t) = byte_memset;
+static void *(*volatile new_memset) (void *, int, size_t) = memset;
+static int (*volatile old_memcmp) (const void *, const void *, size_t)
+  = byte_memcmp;
+static int (*volatile new_memcmp) (const void *, const void *, size_t)
+  = memcmp;
+
+/* Benchmark the block operations. */
+void
+test (void)
+{
+  int ofs;
+
+  random_bytes (src, sizeof src);
+  for (ofs = 0; ofs < 4; ofs++)
+    {
+      uint64_t start, before, after;
+      int i;
+
+      /* memcpy(). */
+      start = rdtsc ();
+      for (i = 0; i < REPEAT; i++)
+        {
+          old_memcpy (dst + ofs, src, BLOCK_SIZE);
+          barrier ();
+        }
+      before = rdtsc () - start;
+      start = rdtsc ();
+      for (i = 0; i < REPEAT; i++)
+        {
+          new_memcpy (dst + ofs, src, BLOCK_SIZE);
+          barrier ();
+        }
+      after = rdtsc () - start;
+      ASSERT (byte_memcmp (dst + ofs, src, BLOCK_SIZE) == 0);
+      report ("memcpy", ofs, before, after);
+
+      /* memset(). */
+      start = rdtsc ();
+      for (i = 0; i < REPEAT; i++)
+        {
+          old_memset (dst + ofs, 0, BLOCK_SIZE);
+          barrier ();
+        }
+      before = rdtsc () - start;
+      start = rdtsc ();
+      for (i = 0; i < REPEAT; i++)
+        {
+          new_memset (dst + ofs, 0xa5, BLOCK_SIZE);
+          barrier ();
+        }
+      after = rdtsc () - start;
+      for (i = 0; i < BLOCK_SIZE; i++)
+        ASSERT (dst[ofs + i] == 0xa5);
+      report ("memset", ofs, before, after);
+
+      /* memcmp() on equal blocks, which must look at every
+         byte. */
+      memcpy (dst + ofs, src + ofs, BLOCK_SIZE);
+      start = rdtsc ();
+      for (i = 0; i < REPEAT; i++)
+        ASSERT (old_memcmp (dst + ofs, src + ofs, BLOCK_SIZE) == 0);
+      before = rdtsc () - start;
+      start = rdtsc ();
+      for (i = 0; i < REPEAT; i++)
+        ASSERT (new_memcmp (dst + ofs, src + ofs, BLOCK_SIZE) == 0);
+      after = rdtsc () - start;
+      report ("memcmp", ofs, before, after);
+
+      /* memcmp() must still find the first difference. */
+      dst[ofs + BLOCK_SIZE - 1] ^= 1;
+      ASSERT (new_memcmp (dst + ofs, src + ofs, BLOCK_SIZE)
+              == byte_memcmp (dst + ofs, src + ofs, BLOCK_SIZE));
+      ASSERT (new_memcmp (src + ofs, dst + ofs, BLOCK_SIZE)
+              == byte_memcmp (src + ofs, dst + ofs, BLOCK_SIZE));
+    }
+
+  printf ("string: PASS\n");
+}
+
+/* Prints the cycles per KB taken by operation NAME at
+   destination offset OFS, BEFORE with the old byte loop and
+   AFTER with the lib/string.c version. */
+static void
+report (const char *name, int ofs, uint64_t before, uint64_t after)
+{
+  unsigned kbs = REPEAT * BLOCK_SIZE / 1024;
+
+  printf ("%s, offset %d: %llu cycles/KB before, %llu cycles/KB after\n",
+          name, ofs, before / kbs, after / kbs);
+}
+
+/* Returns the processor's time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* The old memcpy(), for comparison. */
+static void *
+byte_memcpy (void *dst_, const void *src_, size_t size)
+{
+  unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  ASSERT (dst != NULL || size == 0);
+  ASSERT (src != NULL || size == 0);
+
+  while (size-- > 0)
+    *dst++ = *src++;
+
+  return dst_;
+}
+
+/* The old memset(), for comparison. */
+static void *
+byte_memset (void *dst_, int value, size_t size)
+{
+  unsigned char *dst = dst_;
+
+  ASSERT (dst != NULL || size == 0);
+
+  while (size-- > 0)
+    *dst++ = value;
+
+  return dst_;
+}
+
+/* The old memcmp(), for comparison. */
+static int
+byte_memcmp (const void *a_, const void *b_, size_t size)
+{
+  const unsigned char *a = a_;
+  const unsigned char *b = b_;
+
+  ASSERT (a != NULL || size == 0);
+  ASSERT (b != NULL || size == 0);
+
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
@@ -0,0 +1,50 @@
+/* Forks a process whose data pages are resident and writable,
+   then has both parent and child write to them.  Each must see
+   only its own writes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 4096)
+
+static char buf[SIZE];
+
+/* Fails unless every byte of buf is C. */
+static void
+check_buf (char c, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != c)
+      fail ("%s: byte %zu is '%c' (should be '%c')", who, i, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  int status;
+
+  memset (buf, 'a', sizeof buf);
+  CHECK ((child = fork ()) != PID_ERROR, "fork");
+  if (child == 0)
+    {
+      msg ("child sees parent's data");
+      check_buf ('a', "child");
+      memset (buf, 'c', sizeof buf);
+      msg ("child sees its own writes");
+      check_buf ('c', "child");
+      exit (81);
+    }
+
+  /* Write before the child is done, so that both sides break
+     the sharing. */
+  memset (buf, 'p', sizeof buf);
+  status = wait (child);
+  CHECK (status == 81, "wait for child");
+  msg ("parent sees only its own writes");
+  check_buf ('p', "parent");
+}
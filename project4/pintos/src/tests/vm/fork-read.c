@@ -0,0 +1,56 @@
+/* Forks, then has the child read() a file into a buffer that is
+   still shared copy-on-write with the parent, so that read()
+   itself has to give the child private copies of both pages the
+   buffer spans before reading the file into them.  The child must
+   get the file's data and the parent must not. */
+
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3 * 4096];
+
+/* Reads sample.txt from the start of HANDLE into TARGET and
+   checks the data. */
+static void
+read_sample (int handle, char *target, const char *who)
+{
+  seek (handle, 0);
+  if (read (handle, target, sizeof sample - 1) != (int) sizeof sample - 1)
+    fail ("%s: read \"sample.txt\" returned wrong size", who);
+  if (memcmp (target, sample, sizeof sample - 1))
+    fail ("%s: read of \"sample.txt\" returned bad data", who);
+}
+
+void
+test_main (void)
+{
+  char *target = (char *) ROUND_DOWN ((uintptr_t) buf + 2 * 4096, 4096) - 100;
+  int handle;
+  pid_t child;
+  int status;
+  size_t i;
+
+  memset (buf, 'x', sizeof buf);
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((child = fork ()) != PID_ERROR, "fork");
+  if (child == 0)
+    {
+      msg ("read \"sample.txt\" in child");
+      read_sample (handle, target, "child");
+      exit (82);
+    }
+
+  status = wait (child);
+  CHECK (status == 82, "wait for child");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'x')
+      fail ("parent: byte %zu changed by child's read", i);
+  msg ("read \"sample.txt\" in parent");
+  read_sample (handle, target, "parent");
+  close (handle);
+}
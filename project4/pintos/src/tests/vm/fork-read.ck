@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-read) begin
+(fork-read) open "sample.txt"
+(fork-read) fork
+(fork-read) read "sample.txt" in child
+(fork-read) wait for child
+(fork-read) read "sample.txt" in parent
+(fork-read) end
+EOF
+pass;
@@ -33,6 +33,7 @@
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/page.h"
 #include "vm/swap.h"
 #endif
 #ifdef FILESYS
@@ -106,6 +107,7 @@ main (void)
 #ifdef VM
   /* Initialize Virtual memory system. (Project 3) */
   frame_management_init();
+  vm_page_init();
 #endif
 
   /* Segmentation. */
@@ -137,6 +139,7 @@ main (void)
 #endif
 #ifdef VM
   swap_initialize ();
+  frame_pageout_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,16 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Freed big blocks of up to BIG_BIN_CNT pages are not returned
+   to the page allocator right away.  A few of each size are
+   kept in bins, from which later requests of the same size are
+   served.  The bins are emptied whenever the kernel pool runs
+   out of pages, whoever was asking: palloc_get_multiple() calls
+   malloc_drain() and tries again.  realloc() grows and shrinks big blocks in
+   place when it can, growing into the pages that follow the
+   block if they are free. */
 
 /* Descriptor. */
 struct desc
@@ -64,14 +74,24 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Freed big blocks, binned by page count. */
+#define BIG_BIN_CNT 8           /* Bins for 1...BIG_BIN_CNT pages. */
+#define BIG_BIN_DEPTH 2         /* Maximum number of blocks per bin. */
+static struct list big_bins[BIG_BIN_CNT];
+static size_t big_bin_size[BIG_BIN_CNT];
+static struct lock big_lock;    /* Protects the bins. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct arena *big_get (size_t page_cnt);
+static void big_put (struct arena *);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t i;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
@@ -82,6 +102,13 @@ malloc_init (void)
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+
+  for (i = 0; i < BIG_BIN_CNT; i++)
+    {
+      list_init (&big_bins[i]);
+      big_bin_size[i] = 0;
+    }
+  lock_init (&big_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -107,7 +134,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = big_get (page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -199,13 +226,44 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block == NULL)
+    return malloc (new_size);
   else 
     {
-      void *new_block = malloc (new_size);
-      if (old_block != NULL && new_block != NULL)
+      struct arena *a = block_to_arena (old_block);
+      size_t old_size = block_size (old_block);
+      size_t min_size;
+      void *new_block;
+
+      if (a->desc == NULL)
         {
-          size_t old_size = block_size (old_block);
-          size_t min_size = new_size < old_size ? new_size : old_size;
+          /* Big block.  Give back pages it no longer needs, or
+             take the free pages right after it. */
+          size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+          if (page_cnt <= a->free_cnt)
+            {
+              palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                                    a->free_cnt - page_cnt);
+              a->free_cnt = page_cnt;
+              return old_block;
+            }
+          if (palloc_grow_multiple (a, a->free_cnt, page_cnt))
+            {
+              a->free_cnt = page_cnt;
+              return old_block;
+            }
+        }
+      else if (new_size <= old_size
+               && (new_size > old_size / 2 || a->desc == descs))
+        {
+          /* malloc() would pick the same descriptor. */
+          return old_block;
+        }
+
+      new_block = malloc (new_size);
+      if (new_block != NULL)
+        {
+          min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
           free (old_block);
         }
@@ -256,8 +314,9 @@ free (void *p)
         }
       else
         {
-          /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
+          /* It's a big block.  Keep it for reuse or free its
+             pages. */
+          big_put (a);
           return;
         }
     }
@@ -292,3 +351,87 @@ arena_to_block (struct arena *a, size_t idx)
                            + sizeof *a
                            + idx * a->desc->block_size);
 }
+
+/* Returns an arena of PAGE_CNT pages for a big block, from the
+   bins if possible.  Returns a null pointer if memory is not
+   available. */
+static struct arena *
+big_get (size_t page_cnt)
+{
+  struct arena *a = NULL;
+
+  if (page_cnt <= BIG_BIN_CNT)
+    {
+      struct list *bin = &big_bins[page_cnt - 1];
+
+      lock_acquire (&big_lock);
+      if (!list_empty (bin))
+        {
+          struct block *b = list_entry (list_pop_front (bin),
+                                        struct block, free_elem);
+          a = block_to_arena (b);
+          big_bin_size[page_cnt - 1]--;
+        }
+      lock_release (&big_lock);
+    }
+  if (a == NULL)
+    a = palloc_get_multiple (0, page_cnt);
+  return a;
+}
+
+/* Frees big block arena A, putting it in its bin unless the bin
+   is full. */
+static void
+big_put (struct arena *a)
+{
+  size_t page_cnt = a->free_cnt;
+
+  if (page_cnt <= BIG_BIN_CNT)
+    {
+      struct block *b = (struct block *) (a + 1);
+
+#ifndef NDEBUG
+      /* Clear the block to help detect use-after-free bugs. */
+      memset (b, 0xcc, PGSIZE * page_cnt - sizeof *a);
+#endif
+
+      lock_acquire (&big_lock);
+      if (big_bin_size[page_cnt - 1] < BIG_BIN_DEPTH)
+        {
+          list_push_front (&big_bins[page_cnt - 1], &b->free_elem);
+          big_bin_size[page_cnt - 1]++;
+          lock_release (&big_lock);
+          return;
+        }
+      lock_release (&big_lock);
+    }
+  palloc_free_multiple (a, page_cnt);
+}
+
+/* Returns every block in the big block bins to the page
+   allocator.  Returns true if there were any.  Called by the
+   page allocator when the kernel pool runs out, so it must not
+   allocate.  Does nothing in an interrupt handler, which cannot
+   take big_lock. */
+bool
+malloc_drain (void)
+{
+  bool drained = false;
+  size_t i;
+
+  if (intr_context ())
+    return false;
+  lock_acquire (&big_lock);
+  for (i = 0; i < BIG_BIN_CNT; i++)
+    while (!list_empty (&big_bins[i]))
+      {
+        struct block *b = list_entry (list_pop_front (&big_bins[i]),
+                                      struct block, free_elem);
+        palloc_free_multiple (block_to_arena (b), i + 1);
+        drained = true;
+      }
+  for (i = 0; i < BIG_BIN_CNT; i++)
+    big_bin_size[i] = 0;
+  lock_release (&big_lock);
+  return drained;
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/loader.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -81,6 +82,15 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
   lock_release (&pool->lock);
 
+  /* malloc() keeps some freed kernel pages for reuse.  Take them
+     back before giving up. */
+  if (page_idx == BITMAP_ERROR && pool == &kernel_pool && malloc_drain ())
+    {
+      lock_acquire (&pool->lock);
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      lock_release (&pool->lock);
+    }
+
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
   else
@@ -141,6 +151,44 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
 }
 
+/* Extends the group of PAGE_CNT pages at PAGES, obtained from
+   palloc_get_multiple(), to NEW_CNT pages by taking the pages
+   that follow it.  Returns true if successful.  Returns false,
+   changing nothing, if any of those pages is in use or lies past
+   the end of the pool. */
+bool
+palloc_grow_multiple (void *pages, size_t page_cnt, size_t new_cnt)
+{
+  struct pool *pool;
+  size_t page_idx;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+
+  lock_acquire (&pool->lock);
+  if (page_idx + new_cnt <= bitmap_size (pool->used_map)
+      && !bitmap_any (pool->used_map, page_idx + page_cnt,
+                      new_cnt - page_cnt))
+    {
+      bitmap_set_multiple (pool->used_map, page_idx + page_cnt,
+                           new_cnt - page_cnt, true);
+      success = true;
+    }
+  lock_release (&pool->lock);
+
+  return success;
+}
+
 /* Frees the page at PAGE. */
 void
 palloc_free_page (void *page) 
@@ -148,6 +196,16 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the base of the user pool and stores the number of
+   pages in it into *PAGE_CNT.  Every page returned by
+   palloc_get_page(PAL_USER) lies in this range. */
+void *
+palloc_user_pool (size_t *page_cnt)
+{
+  *page_cnt = bitmap_size (user_pool.used_map);
+  return user_pool.base;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -0,0 +1,197 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator, after Bonwick's.
+
+   Each kmem_cache hands out objects of one exact size, rounded
+   up only to pointer alignment.  Its objects live in slabs: a
+   slab is one page from the page allocator with a header at the
+   start, followed by as many objects as fit.  The free objects
+   of a slab are chained through their first word.
+
+   A cache allocates from its partially used slabs first, so
+   that the objects in use stay packed into few pages.  Slabs
+   whose objects are all in use sit on a separate list, where
+   allocation never looks at them.  When a slab becomes entirely
+   free it is kept as the cache's spare, so that a cache whose
+   object count hovers around a slab boundary does not get and
+   free a page on every call; a second free slab goes back to
+   the page allocator.
+
+   Finding an object's slab is a matter of rounding its address
+   down to a page boundary, so freeing an object needs no
+   search, and every operation holds the cache's lock for a
+   constant amount of work. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of the slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in PARTIAL or FULL. */
+    size_t used_cnt;            /* Number of objects in use. */
+    void *free;                 /* First free object. */
+  };
+
+/* Offset of the first object within a slab. */
+#define SLAB_OBJ_OFS ROUND_UP (sizeof (struct slab), sizeof (void *))
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+
+/* Initializes C as a cache of objects of SIZE bytes each, which
+   must fit in a page along with a slab header.  NAME is used
+   only for debugging. */
+void
+kmem_cache_init (struct kmem_cache *c, const char *name, size_t size)
+{
+  if (size < sizeof (void *))
+    size = sizeof (void *);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size, sizeof (void *));
+  c->objs_per_slab = (PGSIZE - SLAB_OBJ_OFS) / c->obj_size;
+  ASSERT (c->objs_per_slab > 0);
+  list_init (&c->partial);
+  list_init (&c->full);
+  c->empty = NULL;
+  lock_init (&c->lock);
+}
+
+/* Obtains and returns a new object from cache C.  Its contents
+   are undefined.  Returns a null pointer if memory is not
+   available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial))
+    {
+      s = c->empty;
+      c->empty = NULL;
+      if (s == NULL)
+        s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  s = list_entry (list_front (&c->partial), struct slab, elem);
+  obj = s->free;
+  s->free = *(void **) obj;
+  if (++s->used_cnt == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+  lock_release (&c->lock);
+  return obj;
+}
+
+/* Like kmem_cache_alloc(), but the object is zeroed. */
+void *
+kmem_cache_zalloc (struct kmem_cache *c)
+{
+  void *obj = kmem_cache_alloc (c);
+  if (obj != NULL)
+    memset (obj, 0, c->obj_size);
+  return obj;
+}
+
+/* Returns object P, which must have been allocated from cache C,
+   to C.  Does nothing if P is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *c, void *p)
+{
+  struct slab *s, *spare = NULL;
+
+  if (p == NULL)
+    return;
+  s = obj_to_slab (c, p);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (p, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+  ASSERT (s->used_cnt > 0);
+  if (s->used_cnt-- == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  *(void **) p = s->free;
+  s->free = p;
+
+  if (s->used_cnt == 0)
+    {
+      list_remove (&s->elem);
+      if (c->empty == NULL)
+        c->empty = s;
+      else
+        spare = s;
+    }
+  lock_release (&c->lock);
+
+  if (spare != NULL)
+    palloc_free_page (spare);
+}
+
+/* Allocates a slab for cache C, with all of its objects free.
+   Returns a null pointer if memory is not available. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  uint8_t *obj;
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->used_cnt = 0;
+  s->free = NULL;
+
+  /* Chain the objects so that they are handed out in address
+     order. */
+  obj = (uint8_t *) s + SLAB_OBJ_OFS + (c->objs_per_slab - 1) * c->obj_size;
+  for (i = 0; i < c->objs_per_slab; i++, obj -= c->obj_size)
+    {
+      *(void **) obj = s->free;
+      s->free = obj;
+    }
+  return s;
+}
+
+/* Returns the slab that holds object P of cache C. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *p)
+{
+  struct slab *s = pg_round_down (p);
+
+  /* Check that the slab is valid. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT (pg_ofs (p) >= SLAB_OBJ_OFS);
+  ASSERT ((pg_ofs (p) - SLAB_OBJ_OFS) % c->obj_size == 0);
+
+  return s;
+}
@@ -0,0 +1,29 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* A cache of objects of a single size, carved out of one-page
+   "slabs".  Suits structures that are allocated and freed
+   often, since objects are not rounded up to a power of 2 the
+   way malloc() rounds them, and each cache has a lock of its
+   own. */
+struct kmem_cache
+  {
+    const char *name;           /* For debugging. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct slab *empty;         /* A spare slab with no used objects. */
+    struct lock lock;           /* Protects all of the above. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size);
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_zalloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
+#endif /* threads/slab.h */
@@ -474,7 +474,9 @@ init_thread (struct thread *t, const char *name, int priority)
   // init process-related informations.
   t->pcb = NULL;
   list_init(&t->child_list);
-  list_init(&t->file_descriptors);
+  t->fd_table = NULL;
+  t->fd_cap = 0;
+  t->fd_free = FD_MIN;
   t->executing_file = NULL;
 #endif
 #ifdef VM
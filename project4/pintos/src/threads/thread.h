@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 
@@ -108,7 +109,10 @@ struct thread
     struct list child_list;             /* List of children processes of this thread,
                                           each elem is defined by pcb#elem */
 
-    struct list file_descriptors;       /* List of file_descriptors the thread contains */
+    struct file **fd_table;             /* Open files, indexed by file descriptor.
+                                           Grown by syscall.c as needed. */
+    int fd_cap;                         /* Number of slots in fd_table. */
+    int fd_free;                        /* Every fd below this one is in use. */
 
     struct file *executing_file;        /* The executable file of associated process. */
 
@@ -125,6 +129,10 @@ struct thread
     struct list mmap_list;              /* List of struct mmap_desc. */
 #endif
 
+    /* Owned by devices/timer.c. */
+    int64_t sleep_tick;                 /* Tick to wake up at. */
+    struct heap_elem sleep_elem;        /* Element in sleep heap. */
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
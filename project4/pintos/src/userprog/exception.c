@@ -173,7 +173,10 @@ page_fault (struct intr_frame *f)
   void* fault_page = (void*) pg_round_down(fault_addr);
 
   if (!not_present) {
-    // attempt to write to a read-only region is always killed.
+    // a write to a copy-on-write or zero page gets its own copy.
+    if (write && vm_page_cow(curr->supt, curr->pagedir, fault_page))
+      return;
+    // any other attempt to write to a read-only region is killed.
     goto PAGE_FAULT_VIOLATED_ACCESS;
   }
 
@@ -195,7 +198,7 @@ page_fault (struct intr_frame *f)
       supplemental_zeropage_install (curr->supt, fault_page);
   }
 
-  if(! vm_page_load(curr->supt, curr->pagedir, fault_page) ) {
+  if(! vm_page_fault(curr->supt, curr->pagedir, fault_page, write) ) {
     goto PAGE_FAULT_VIOLATED_ACCESS;
   }
 
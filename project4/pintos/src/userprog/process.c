@@ -28,6 +28,10 @@
 #endif
 
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func fork_process NO_RETURN;
+static bool fork_files (struct thread *parent);
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 static void push_arguments (const char *[], int cnt, void **esp);
 
@@ -171,6 +175,137 @@ finish_step:
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Arguments passed from process_fork() to fork_process(). */
+struct fork_args
+  {
+    struct process_control_block *pcb;  /* The child's PCB. */
+    struct thread *parent;              /* The forking process. */
+    struct intr_frame if_;              /* Parent's user context. */
+  };
+
+/* Creates a child process that is a copy of the current one and
+   resumes user mode from F, like the parent, but with 0 as the
+   return value.  The child gets its own handles on the parent's
+   executable and open files; mmap()ed regions are not inherited.
+   Memory is not copied: resident pages are shared copy-on-write
+   and copied on the first write by either side.  Returns the
+   child's pid, or PID_ERROR on failure. */
+pid_t
+process_fork (struct intr_frame *f)
+{
+  struct fork_args args;
+  struct process_control_block *pcb;
+  tid_t tid;
+
+  pcb = palloc_get_page (0);
+  if (pcb == NULL)
+    return PID_ERROR;
+
+  pcb->pid = PID_INITIALIZING;
+  pcb->cmdline = NULL;
+  pcb->waiting = false;
+  pcb->exited = false;
+  pcb->orphan = false;
+  pcb->exitcode = -1;
+  sema_init (&pcb->sema_initialization, 0);
+  sema_init (&pcb->sema_wait, 0);
+
+  args.pcb = pcb;
+  args.parent = thread_current ();
+  args.if_ = *f;
+
+  /* We stay blocked until the child has copied what it needs
+     from us, so ARGS and our address space hold still. */
+  tid = thread_create (thread_name (), PRI_DEFAULT, fork_process, &args);
+  if (tid == TID_ERROR)
+    {
+      palloc_free_page (pcb);
+      return PID_ERROR;
+    }
+  sema_down (&pcb->sema_initialization);
+
+  if (pcb->pid >= 0)
+    list_push_back (&thread_current ()->child_list, &pcb->elem);
+  return pcb->pid;
+}
+
+/* A thread function that builds a forked child process from the
+   parent described by ARGS_ and starts it running. */
+static void
+fork_process (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *t = thread_current ();
+  struct thread *parent = args->parent;
+  struct process_control_block *pcb = args->pcb;
+  struct intr_frame if_ = args->if_;
+  bool success;
+
+  t->pagedir = pagedir_create ();
+  t->supt = (struct supplemental_page_table *) supplemental_table_create ();
+  success = (t->pagedir != NULL && t->supt != NULL
+             && fork_files (parent)
+             && supplemental_table_fork (t->supt, t->pagedir,
+                                         parent->supt, parent->pagedir,
+                                         parent->executing_file,
+                                         t->executing_file));
+  if (success)
+    process_activate ();
+
+  pcb->pid = success ? (pid_t)(t->tid) : PID_ERROR;
+  t->pcb = pcb;
+
+  sema_up (&pcb->sema_initialization);
+
+  if (!success)
+    exit (-1);
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current thread its own handles on PARENT's
+   executable and open files, at the same file positions.
+   Returns false if out of memory. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  int fd;
+
+  if (parent->executing_file != NULL)
+    {
+      cur->executing_file = file_reopen (parent->executing_file);
+      if (cur->executing_file == NULL)
+        return false;
+      file_deny_write (cur->executing_file);
+    }
+
+  if (parent->fd_cap == 0)
+    return true;
+  cur->fd_table = calloc (parent->fd_cap, sizeof *cur->fd_table);
+  if (cur->fd_table == NULL)
+    return false;
+  cur->fd_cap = parent->fd_cap;
+  cur->fd_free = parent->fd_free;
+  for (fd = FD_MIN; fd < parent->fd_cap; fd++)
+    {
+      struct file *file = parent->fd_table[fd];
+
+      if (file == NULL)
+        continue;
+      cur->fd_table[fd] = file_reopen (file);
+      if (cur->fd_table[fd] == NULL)
+        return false;
+      file_seek (cur->fd_table[fd], file_tell (file));
+    }
+  return true;
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -224,13 +359,14 @@ process_wait (tid_t child_tid)
 
 static void file_close_all(void) {
     struct thread *cur = thread_current();
-    struct list *fdlist = &cur->file_descriptors;
-    while (!list_empty(fdlist)) {
-        struct list_elem *e = list_pop_front(fdlist);
-        struct file_desc *desc = list_entry(e, struct file_desc, elem);
-        file_close(desc->file);
-        palloc_free_page(desc);
+    int fd;
+    for (fd = FD_MIN; fd < cur->fd_cap; fd++) {
+        if (cur->fd_table[fd] != NULL)
+            file_close(cur->fd_table[fd]);
     }
+    free(cur->fd_table);
+    cur->fd_table = NULL;
+    cur->fd_cap = 0;
 }
 
 #ifdef VM
@@ -285,6 +421,14 @@ void process_exit(void) {
     unmap_all();
 #endif
     release_children();
+#ifdef VM
+    /* Our code frames stay in the page cache, keyed by the
+       executable's inode, for as long as we map them.  Drop them
+       while the executable is still write-denied, so that no other
+       process can find them once the file may change. */
+    supplemental_table_destroy(cur->supt);
+    cur->supt = NULL;
+#endif
     close_executing_file();
 
     cur->pcb->exited = true;
@@ -294,11 +438,6 @@ void process_exit(void) {
         palloc_free_page(cur->pcb);
     }
 
-#ifdef VM
-    supplemental_table_destroy(cur->supt);
-    cur->supt = NULL;
-#endif
-
     destroy_pagedir();
 }
 
@@ -579,6 +718,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* The whole segment is one VMA; each page gets its entry when
+     it is first touched. */
+  return supplemental_vma_install (thread_current ()->supt, upage, file, ofs,
+                                   read_bytes, zero_bytes, writable, false);
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -588,15 +733,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-#ifdef VM
-      struct thread *curr = thread_current ();
-      ASSERT (pagedir_get_page(curr->pagedir, upage) == NULL);
-
-      if (! supplemental_filesys_install(curr->supt, upage,
-            file, ofs, page_read_bytes, page_zero_bytes, writable) ) {
-        return false;
-      }
-#else
       /* Get a page of memory. */
       uint8_t *kpage = frame_allocate(PAL_USER, upage);
       if (kpage == NULL)
@@ -616,17 +752,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           frame_release (kpage);
           return false; 
         }
-#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
-#ifdef VM
-      ofs += PGSIZE;
-#endif
     }
   return true;
+#endif
 }
 
 
@@ -11,6 +11,10 @@ typedef int pid_t;
 
 
 pid_t process_execute (const char *cmdline);
+#ifdef VM
+struct intr_frame;
+pid_t process_fork (struct intr_frame *);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
@@ -31,11 +35,9 @@ struct process_control_block {
   struct semaphore sema_wait;            
 };
 
-struct file_desc {
-  int id;
-  struct list_elem elem;
-  struct file* file;
-};
+/* Lowest file descriptor handed out by open(); 0 to 2 belong to
+   the console. */
+#define FD_MIN 3
 
 #ifdef VM
 typedef int mmapid_t;
@@ -7,6 +7,8 @@
 #include "threads/palloc.h"
 #include "threads/malloc.h"
 #include <stdio.h>
+#include <round.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -15,6 +17,7 @@
 #include "threads/synch.h"
 #include "lib/kernel/list.h"
 #ifdef VM
+#include "threads/slab.h"
 #include "vm/page.h"
 #endif
 
@@ -22,7 +25,12 @@ static void syscall_handler (struct intr_frame *);
 
 static int memread_user (void *src, void *des, size_t bytes);
 
-static struct file_desc* find_file_desc(struct thread *, int fd);
+/* Number of slots in a process's file descriptor table when it
+   first opens a file.  The table doubles whenever it fills up. */
+#define FD_TABLE_INIT 16
+
+static int alloc_fd(struct thread *, struct file *);
+static struct file* find_file(struct thread *, int fd);
 
 void halt (void);
 void exit (int);
@@ -45,23 +53,16 @@ bool munmap(mmapid_t);
 
 static struct mmap_desc* find_mmap_desc(struct thread *, mmapid_t fd);
 
-void pin_preload_pages(const void *, size_t);
+/* Cache of mmap_descs. */
+static struct kmem_cache mmap_cache;
+
+void pin_preload_pages(const void *, size_t, bool write);
 void unpin_preloaded_pages(const void *, size_t);
 #endif
-struct file
-  {
-    struct inode *inode;        /* File's inode. */
-    off_t pos;                  /* Current position. */
-    bool deny_write;            /* Has file_deny_write() been called? */
-  };
 static void syscall_handler (struct intr_frame *);
 void check_user_vaddr(const void *vaddr);
-struct lock filesys_lock;
 
 static void fail_invalid_access(void) {
-  if (lock_held_by_current_thread(&filesys_lock))
-    lock_release (&filesys_lock);
-
   exit (-1);
   NOT_REACHED();
 }
@@ -74,8 +75,10 @@ void check_user_vaddr(const void *vaddr) {
 void
 syscall_init (void)
 {
-  lock_init (&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+#ifdef VM
+  kmem_cache_init (&mmap_cache, "mmap_desc", sizeof (struct mmap_desc));
+#endif
 }
 
 static void
@@ -158,6 +161,10 @@ syscall_handler (struct intr_frame *f)
       munmap(mid);
       break;
     }
+
+  case SYS_FORK:
+    f->eax = process_fork(f);
+    break;
 #endif
   }
 
@@ -199,9 +206,7 @@ check_user (const uint8_t *uaddr) {
 
 pid_t exec (const char *cmd_line) {
   check_user((const uint8_t*) cmd_line);
-  lock_acquire (&filesys_lock);
   pid_t pid = process_execute(cmd_line);
-  lock_release (&filesys_lock);
   return pid;
 }
 
@@ -213,9 +218,7 @@ bool create (const char* filename, unsigned initial_size) {
   bool return_code;
   check_user((const uint8_t*) filename);
 
-  lock_acquire (&filesys_lock);
   return_code = filesys_create(filename, initial_size);
-  lock_release (&filesys_lock);
   return return_code;
 }
 
@@ -223,9 +226,7 @@ bool remove (const char* filename) {
   bool return_code;
   check_user((const uint8_t*) filename);
 
-  lock_acquire (&filesys_lock);
   return_code = filesys_remove(filename);
-  lock_release (&filesys_lock);
   return return_code;
 }
 
@@ -233,47 +234,30 @@ int open(const char* file) {
   check_user((const uint8_t*) file);
 
   struct file* file_opened;
-  struct file_desc* fd = palloc_get_page(0);
-  if (!fd) {
-    return -1;
-  }
+  int fd;
 
-  lock_acquire (&filesys_lock);
   file_opened = filesys_open(file);
   if (!file_opened) {
-    palloc_free_page (fd);
-    lock_release (&filesys_lock);
     return -1;
   }
 
-  fd->file = file_opened;
+  fd = alloc_fd(thread_current(), file_opened);
+  if (fd < 0)
+    file_close(file_opened);
 
-  struct list* fd_list = &thread_current()->file_descriptors;
-  if (list_empty(fd_list)) {
-    fd->id = 3;
-  }
-  else {
-    fd->id = (list_entry(list_back(fd_list), struct file_desc, elem)->id) + 1;
-  }
-  list_push_back(fd_list, &(fd->elem));
-
-  lock_release (&filesys_lock);
-  return fd->id;
+  return fd;
 }
 
 int filesize(int fd) {
-  struct file_desc* file_d;
+  struct file* file;
 
-  lock_acquire (&filesys_lock);
-  file_d = find_file_desc(thread_current(), fd);
+  file = find_file(thread_current(), fd);
 
-  if(file_d == NULL) {
-    lock_release (&filesys_lock);
+  if(file == NULL) {
     return -1;
   }
 
-  int ret = file_length(file_d->file);
-  lock_release (&filesys_lock);
+  int ret = file_length(file);
   return ret;
 }
 
@@ -294,29 +278,27 @@ int read (int fd, void *buffer, unsigned size) {
   check_user((const uint8_t*) buffer);
   check_user((const uint8_t*) buffer + size - 1);
 
-  lock_acquire (&filesys_lock);
   int ret;
 
   if(fd == 0) {
     unsigned i;
     for(i = 0; i < size; ++i) {
       if(! put_user(buffer + i, input_getc()) ) {
-        lock_release (&filesys_lock);
         exit(-1);
       }
     }
     ret = size;
   }
   else {
-    struct file_desc* file_d = find_file_desc(thread_current(), fd);
+    struct file* file = find_file(thread_current(), fd);
 
-    if(file_d && file_d->file) {
+    if(file) {
 
 #ifdef VM
-      pin_preload_pages(buffer, size);
+      pin_preload_pages(buffer, size, true);
 #endif
 
-      ret = file_read(file_d->file, buffer, size);
+      ret = file_read(file, buffer, size);
 
 #ifdef VM
       unpin_preloaded_pages(buffer, size);
@@ -326,7 +308,6 @@ int read (int fd, void *buffer, unsigned size) {
       ret = -1;
   }
 
-  lock_release (&filesys_lock);
   return ret;
 }
 
@@ -334,21 +315,20 @@ int write (int fd, const void *buffer, unsigned size) {
   check_user((const uint8_t*) buffer);
   check_user((const uint8_t*) buffer + size - 1);
 
-  lock_acquire (&filesys_lock);
   int ret;
   if(fd == 1) {
     putbuf(buffer, size);
     ret = size;
   }
   else {
-    struct file_desc* file_d = find_file_desc(thread_current(), fd);
+    struct file* file = find_file(thread_current(), fd);
 
-    if(file_d && file_d->file) {
+    if(file) {
 #ifdef VM
-      pin_preload_pages(buffer, size);
+      pin_preload_pages(buffer, size, false);
 #endif
 
-      ret = file_write(file_d->file, buffer, size);
+      ret = file_write(file, buffer, size);
 
 #ifdef VM
       unpin_preloaded_pages(buffer, size);
@@ -358,47 +338,39 @@ int write (int fd, const void *buffer, unsigned size) {
       ret = -1;
   }
 
-  lock_release (&filesys_lock);
   return ret;
 }
 
 void seek(int fd, unsigned position) {
-  lock_acquire (&filesys_lock);
-  struct file_desc* file_d = find_file_desc(thread_current(), fd);
+  struct file* file = find_file(thread_current(), fd);
 
-  if(file_d && file_d->file) {
-    file_seek(file_d->file, position);
+  if(file) {
+    file_seek(file, position);
   }
-  else
-    return;
-
-  lock_release (&filesys_lock);
 }
 
 unsigned tell(int fd) {
-  lock_acquire (&filesys_lock);
-  struct file_desc* file_d = find_file_desc(thread_current(), fd);
+  struct file* file = find_file(thread_current(), fd);
 
   unsigned ret;
-  if(file_d && file_d->file) {
-    ret = file_tell(file_d->file);
+  if(file) {
+    ret = file_tell(file);
   }
   else
     ret = -1;
-  lock_release (&filesys_lock);
   return ret;
 }
 
 void close(int fd) {
-  lock_acquire (&filesys_lock);
-  struct file_desc* file_d = find_file_desc(thread_current(), fd);
-
-  if(file_d && file_d->file) {
-    file_close(file_d->file);
-    list_remove(&(file_d->elem));
-    palloc_free_page(file_d);
+  struct thread *t = thread_current();
+  struct file* file = find_file(t, fd);
+
+  if(file) {
+    file_close(file);
+    t->fd_table[fd] = NULL;
+    if (fd < t->fd_free)
+      t->fd_free = fd;
   }
-  lock_release (&filesys_lock);
 }
 
 
@@ -416,17 +388,14 @@ mmapid_t mmap(int fd, void *upage) {
         return -1;
     }
 
-    lock_acquire(&filesys_lock);
-
     struct file *f = NULL;
-    struct file_desc *file_d = find_file_desc(curr, fd);
+    struct file *file = find_file(curr, fd);
 
-    if (file_d != NULL && file_d->file != NULL) {
-        f = file_reopen(file_d->file);
+    if (file != NULL) {
+        f = file_reopen(file);
     }
 
     if (f == NULL) {
-        lock_release(&filesys_lock);
         return -1;
     }
 
@@ -434,39 +403,14 @@ mmapid_t mmap(int fd, void *upage) {
 
     if (file_size == 0) {
         file_close(f);
-        lock_release(&filesys_lock);
         return -1;
     }
 
-    size_t offset;
-
-    for (offset = 0; offset < file_size; offset += PGSIZE) {
-        void *addr = upage + offset;
-        if (supplemental_entry_exist(curr->supt, addr)) {
-            file_close(f);
-            lock_release(&filesys_lock);
-            return -1;
-        }
-    }
-
-    for (offset = 0; offset < file_size; offset += PGSIZE) {
-        void *addr = upage + offset;
-        size_t read_bytes;
-        size_t zero_bytes;
-
-        if (offset + PGSIZE < file_size) {
-            read_bytes = PGSIZE;
-            zero_bytes = 0;
-        } else {
-            read_bytes = file_size - offset;
-            zero_bytes = PGSIZE - read_bytes;
-        }
-
-        if (!supplemental_filesys_install(curr->supt, addr, f, offset, read_bytes, zero_bytes, true)) {
-            file_close(f);
-            lock_release(&filesys_lock);
-            return -1;
-        }
+    /* Pages are read in as they are touched. */
+    if (!supplemental_vma_install(curr->supt, upage, f, 0, file_size,
+                                  ROUND_UP(file_size, PGSIZE) - file_size, true, true)) {
+        file_close(f);
+        return -1;
     }
 
     mmapid_t mid;
@@ -476,10 +420,10 @@ mmapid_t mmap(int fd, void *upage) {
         mid = 1;
     }
 
-    struct mmap_desc *mmap_d = malloc(sizeof(struct mmap_desc));
+    struct mmap_desc *mmap_d = kmem_cache_alloc(&mmap_cache);
     if (mmap_d == NULL) {
+        supplemental_vma_remove(curr->supt, upage);
         file_close(f);
-        lock_release(&filesys_lock);
         return -1;
     }
 
@@ -489,7 +433,6 @@ mmapid_t mmap(int fd, void *upage) {
     mmap_d->size = file_size;
     list_push_back(&curr->mmap_list, &mmap_d->elem);
 
-    lock_release(&filesys_lock);
     return mid;
 }
 
@@ -501,15 +444,19 @@ bool munmap(mmapid_t mid) {
         return false;
     }
 
-    lock_acquire(&filesys_lock);
-
     size_t offset;
     size_t file_size = mmap_d->size;
 
+    /* Only pages that were touched have anything to write back. */
+    supplemental_vma_remove(curr->supt, mmap_d->addr);
     for (offset = 0; offset < file_size; offset += PGSIZE) {
         void *addr = mmap_d->addr + offset;
         size_t bytes;
 
+        if (!supplemental_entry_exist(curr->supt, addr)) {
+            continue;
+        }
+
         if (offset + PGSIZE < file_size) {
             bytes = PGSIZE;
         } else {
@@ -520,9 +467,7 @@ bool munmap(mmapid_t mid) {
     }
     list_remove(&mmap_d->elem);
     file_close(mmap_d->file);
-    free(mmap_d);
-
-    lock_release(&filesys_lock);
+    kmem_cache_free(&mmap_cache, mmap_d);
 
     return true;
 }
@@ -545,29 +490,44 @@ memread_user (void *src, void *dst, size_t bytes)
   return (int)bytes;
 }
 
-static struct file_desc* 
-find_file_desc(struct thread *t, int fd) {
-    ASSERT(t != NULL);
+/* Stores FILE in the lowest free slot of T's file descriptor
+   table, growing the table if it is full, and returns the slot's
+   index as the new fd.  Returns -1 if out of memory. */
+static int
+alloc_fd(struct thread *t, struct file *file) {
+    int fd;
 
-    if (fd < 3) {
-        return NULL;
+    for (fd = t->fd_free; fd < t->fd_cap; fd++) {
+        if (t->fd_table[fd] == NULL)
+            break;
     }
 
-    if (list_empty(&t->file_descriptors)) {
-        return NULL;
+    if (fd >= t->fd_cap) {
+        int cap = t->fd_cap ? t->fd_cap * 2 : FD_TABLE_INIT;
+        struct file **table = realloc(t->fd_table, cap * sizeof *table);
+        if (table == NULL) {
+            return -1;
+        }
+        memset(table + t->fd_cap, 0, (cap - t->fd_cap) * sizeof *table);
+        t->fd_table = table;
+        t->fd_cap = cap;
     }
 
-    struct list_elem *e;
+    t->fd_table[fd] = file;
+    t->fd_free = fd + 1;
+    return fd;
+}
 
-    for (e = list_begin(&t->file_descriptors); e != list_end(&t->file_descriptors); e = list_next(e)) {
-        struct file_desc *desc = list_entry(e, struct file_desc, elem);
-        
-        if (desc->id == fd) {
-            return desc;
-        }
-    }
+/* Returns the file open as FD in T, or a null pointer if FD is
+   not open. */
+static struct file*
+find_file(struct thread *t, int fd) {
+    ASSERT(t != NULL);
 
-    return NULL;
+    if (fd < FD_MIN || fd >= t->fd_cap) {
+        return NULL;
+    }
+    return t->fd_table[fd];
 }
 
 #ifdef VM
@@ -593,7 +553,12 @@ find_mmap_desc(struct thread *t, mmapid_t mid) {
     return NULL;
 }
 
-void pin_preload_pages(const void *buffer, size_t size) {
+/* Loads and pins the pages of BUFFER so that a system call can
+   use it while holding file system locks.  If WRITE is true the
+   kernel is going to write to BUFFER, so copy-on-write pages get
+   their private copy now: breaking the sharing from a fault
+   inside the file system could evict pages through it. */
+void pin_preload_pages(const void *buffer, size_t size, bool write) {
     struct thread *cur = thread_current();
     struct supplemental_page_table *supt = cur->supt;
     uint32_t *pagedir = cur->pagedir;
@@ -606,11 +571,12 @@ void pin_preload_pages(const void *buffer, size_t size) {
     void *end = (void *)((const uint8_t *)buffer + size);
 
     while (upage < end) {
-        if (!vm_page_load(supt, pagedir, upage)) {
+        if (!vm_page_pin(supt, pagedir, upage)) {
             return;
         }
-
-        vm_page_pin(supt, upage); 
+        if (write) {
+            vm_page_cow(supt, pagedir, upage);
+        }
         upage += PGSIZE;
     }
 }
@@ -1,279 +1,830 @@
+
+#include <debug.h>
 #include <hash.h>
 #include <list.h>
+#include <stdint.h>
 #include <stdio.h>
-#include "lib/kernel/hash.h"
-#include "lib/kernel/list.h"
+#include <string.h>
 #include "vm/frame.h"
+#include "vm/page.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "userprog/pagedir.h"
 #include "threads/vaddr.h"
 
-static struct lock frame_lock;
-static struct hash frame_map;
-static struct list frame_list;     
-static struct list_elem *clock_ptr;
-static unsigned frame_hash_func(const struct hash_elem *elem, void *aux);
-static bool     frame_less_func(const struct hash_elem *, const struct hash_elem *, void *aux);
+/* Number of locks the frame table is striped over.  Must be a
+   power of 2. */
+#define FRAME_LOCK_CNT 16
+
+/* Most frames reclaimed by one eviction pass. */
+#define EVICT_BATCH 4
+
+/* The page-out thread wakes up when fewer than one frame in
+   FREE_LOW_DIV is free, and evicts until one in FREE_HIGH_DIV
+   is. */
+#define FREE_LOW_DIV 32
+#define FREE_HIGH_DIV 16
+
+/* One user mapping of a frame. */
+struct frame_map{
+    struct thread *t;           /* Process that maps the frame. */
+    void *upage;                /* Where T maps it. */
+    struct page_entry *spte;    /* T's entry for UPAGE. */
+    unsigned pin_cnt;           /* Pins T holds on the frame. */
+    struct list_elem elem;      /* In frame_table_entry's MORE. */
+};
+
+/* One entry per page of the user pool, indexed by the page's
+   position in the pool.  The kernel address of a frame is
+   implied by its index, so it is not stored.
 
+   A frame is usually mapped by just the process that brought
+   its page in, described by FIRST.  Read-only executable pages
+   are shared through the page cache below; each further mapping
+   of such a frame is a frame_map from map_cache in MORE. */
 struct frame_table_entry{
-    void *kpage;              
-    struct hash_elem helem;  
-    struct list_elem lelem;  
-    void *upage;               
-    struct thread *t;        
-    bool pinned;     
+    struct frame_map first;     /* Oldest mapping. */
+    struct list more;           /* Further mappings, if shared. */
+    unsigned ref_cnt;           /* Number of mappings; 0 if free. */
+    unsigned pin_cnt;           /* Sum of the mappings' pin_cnt.
+                                   Nonzero keeps the frame resident. */
+    bool evicting;              /* Page being written out? */
+
+    /* Page cache key, for read-only executable pages. */
+    bool shared;                /* In share_map? */
+    block_sector_t inumber;     /* Inode of the executable. */
+    off_t ofs;                  /* Offset of the page in it. */
+    uint32_t read_bytes;        /* Bytes of the page read from it. */
+    struct hash_elem share_elem;
 };
 
-static struct frame_table_entry* pick_frame_to_evict(uint32_t* pagedir);
-static void frame_do_free (void *kpage, bool free_page);
+static struct frame_table_entry *frames;
+static struct kmem_cache map_cache;
+static uint8_t *user_base;      /* Kernel address of frames[0]. */
+static size_t frame_cnt;
+
+/* An entry is guarded by frame_locks[idx % FRAME_LOCK_CNT].
+   The matching condition in frame_conds is signaled when one of
+   the entries that lock guards is done evicting.  evict_lock
+   serializes the choice of victims and protects clock_hand and
+   evict_inflight; it is always acquired before any of the
+   striped locks, and never held while a page is written out. */
+static struct lock frame_locks[FRAME_LOCK_CNT];
+static struct condition frame_conds[FRAME_LOCK_CNT];
+static struct lock evict_lock;
+static size_t clock_hand;       /* Back hand of the clock. */
+static size_t clock_spread;     /* Distance to the front hand. */
+static size_t evict_inflight;   /* Frames chosen, not yet evicted. */
+static struct condition evict_idle; /* evict_inflight dropped to 0. */
+
+/* Frames with a nonzero ref_cnt.  Only changed with interrupts
+   off, since it is shared by all the stripes. */
+static size_t used_cnt;
+
+/* Page-out thread.  Faults that leave fewer than free_low frames
+   free signal pageout_cond, and the thread evicts in the
+   background until free_high frames are free again. */
+static size_t free_low, free_high;
+static struct lock pageout_lock;
+static struct condition pageout_cond;
+
+/* Page cache of shared read-only executable pages, keyed by
+   (inumber, ofs, read_bytes).  share_lock may be acquired while
+   holding a striped lock, never the other way around. */
+static struct hash share_map;
+static struct lock share_lock;
+
+static size_t frame_index (void *kpage);
+static struct lock *frame_lock_of (size_t idx);
+static void frame_claim (size_t idx, void *upage);
+static struct condition *frame_cond_of (size_t idx);
+static void *frame_evict (void *upage);
+static size_t frame_reclaim (size_t victims[], size_t want, bool must);
+static bool frame_evict_begin (size_t idx);
+static void frame_evict_finish (size_t idx);
+static bool frame_wait (size_t idx);
+static void frame_count (int delta);
+static size_t frame_free_cnt (void);
+static thread_func frame_pageout NO_RETURN;
+static size_t pick_frame_to_evict (bool must);
+static unsigned frame_do_free (void *kpage, bool free_page, bool unpin);
+static struct frame_map *frame_map_find (struct frame_table_entry *,
+                                         struct thread *);
+static void frame_unshare (struct frame_table_entry *);
+static unsigned frame_share_hash (const struct hash_elem *, void *aux);
+static bool frame_share_less (const struct hash_elem *,
+                              const struct hash_elem *, void *aux);
 
 void frame_management_init() {
-  lock_init (&frame_lock);
-  hash_init (&frame_map, frame_hash_func, frame_less_func, NULL);
-  list_init (&frame_list);
-  clock_ptr = NULL;
-}
+  size_t i;
 
-void* frame_allocate(enum palloc_flags flags, void *upage) {
-  int state = 0, lock_check1 = 0, lock_check2 = 0;
-  void *frame_page = NULL;
-  struct frame_table_entry *f_evicted = NULL;
-  struct frame_table_entry *frame = NULL;
-  bool done = false;
-
-  while (!done) {
-    switch (state) {
-      case 0:
-        lock_check1 = 1;
-        lock_check2 = 1;
-        if (lock_check1 + lock_check2 == 2) {
-          lock_acquire(&frame_lock);
-          state = 1;
-        } else {
-          state = 99;
-        }
-        break;
+  user_base = palloc_user_pool (&frame_cnt);
+  frames = calloc (frame_cnt, sizeof *frames);
+  if (frames == NULL)
+    PANIC ("Can't allocate frame table");
+  for (i = 0; i < FRAME_LOCK_CNT; i++) {
+    lock_init (&frame_locks[i]);
+    cond_init (&frame_conds[i]);
+  }
+  for (i = 0; i < frame_cnt; i++)
+    list_init (&frames[i].more);
+  lock_init (&evict_lock);
+  cond_init (&evict_idle);
+  evict_inflight = 0;
+  kmem_cache_init (&map_cache, "frame_map", sizeof (struct frame_map));
+  hash_init (&share_map, frame_share_hash, frame_share_less, NULL);
+  lock_init (&share_lock);
+  clock_hand = 0;
+  clock_spread = frame_cnt / 4 > 0 ? frame_cnt / 4 : 1;
+  used_cnt = 0;
+  free_low = frame_cnt / FREE_LOW_DIV + 1;
+  free_high = frame_cnt / FREE_HIGH_DIV + 2;
+  lock_init (&pageout_lock);
+  cond_init (&pageout_cond);
+}
 
-      case 1:
-        frame_page = palloc_get_page(PAL_USER | flags);
-        if (frame_page != NULL) {
-          state = 6;
-        } else {
-          state = 2;
-        }
-        break;
+/* Starts the page-out thread.  Must be called once swap is
+   available. */
+void frame_pageout_init (void) {
+  thread_create ("pageout", PRI_DEFAULT, frame_pageout, NULL);
+}
 
-      case 2:
-        f_evicted = pick_frame_to_evict(thread_current()->pagedir);
-
-#if DEBUG
-        printf("f_evicted: %x th=%x, pagedir = %x, up = %x, kp = %x, hash_size=%d\n", f_evicted, f_evicted->t,
-            f_evicted->t->pagedir, f_evicted->upage, f_evicted->kpage, hash_size(&frame_map));
-#endif
-        if (f_evicted != NULL && f_evicted->t != NULL) {
-          state = 3;
-        } else {
-          state = 99;
-        }
-        break;
+void* frame_allocate(enum palloc_flags flags, void *upage) {
+  void *frame_page = frame_try_allocate (flags, upage);
 
-      case 3:
-        if (f_evicted->t->pagedir != (void*)0xcccccccc) {
-          pagedir_clear_page(f_evicted->t->pagedir, f_evicted->upage);
-          bool is_dirty = false;
-          is_dirty = is_dirty || pagedir_is_dirty(f_evicted->t->pagedir, f_evicted->upage);
-          is_dirty = is_dirty || pagedir_is_dirty(f_evicted->t->pagedir, f_evicted->kpage);
-
-          swap_index_t swap_idx = swap_page_out(f_evicted->kpage);
-          supplemental_swap_configure(f_evicted->t->supt, f_evicted->upage, swap_idx);
-          supplemental_dirty_set(f_evicted->t->supt, f_evicted->upage, is_dirty);
-          frame_do_free(f_evicted->kpage, true);
-          state = 4;
-        } else {
-          state = 99;
-        }
-        break;
+  if (frame_page == NULL) {
+    frame_page = frame_evict (upage);
+    if (frame_page != NULL && (flags & PAL_ZERO))
+      memset (frame_page, 0, PGSIZE);
+  }
+  return frame_page;
+}
 
-      case 4:
-        frame_page = palloc_get_page(PAL_USER | flags);
-        if (frame_page != NULL) {
-          state = 5;
-        } else {
-          state = 99;
-        }
-        break;
+/* Like frame_allocate(), but only takes a free frame.  Returns a
+   null pointer instead of evicting when none is left. */
+void* frame_try_allocate(enum palloc_flags flags, void *upage) {
+  void *frame_page = palloc_get_page (PAL_USER | flags);
 
-      case 5:
-        frame = malloc(sizeof(struct frame_table_entry));
-        if (frame != NULL) {
-          state = 7;
-        } else {
-          state = 99;
-        }
-        break;
+  if (frame_page == NULL)
+    return NULL;
 
-      case 6:
-        frame = malloc(sizeof(struct frame_table_entry));
-        if (frame != NULL) {
-          state = 7;
-        } else {
-          lock_release(&frame_lock);
-          return NULL;
-        }
-        break;
+  size_t idx = frame_index (frame_page);
+  lock_acquire (frame_lock_of (idx));
+  frame_claim (idx, upage);
+  lock_release (frame_lock_of (idx));
 
-      case 7:
-        frame->t = thread_current();
-        frame->upage = upage;
-        frame->kpage = frame_page;
-        frame->pinned = true;
-        hash_insert(&frame_map, &frame->helem);
-        list_push_back(&frame_list, &frame->lelem);
-        lock_release(&frame_lock);
-        return frame_page;
-
-      case 99:
-        lock_release(&frame_lock);
-        return NULL;
-    }
+  if (frame_free_cnt () < free_low) {
+    lock_acquire (&pageout_lock);
+    cond_signal (&pageout_cond, &pageout_lock);
+    lock_release (&pageout_lock);
   }
+  return frame_page;
 }
 
 void frame_release (void *kpage) {
-  lock_acquire (&frame_lock);
-  frame_do_free (kpage, true);
-  lock_release (&frame_lock);
+  frame_do_free (kpage, true, false);
+}
+
+/* Like frame_release(), but also drops a pin the caller holds on
+   KPAGE.  Doing both under the frame's lock keeps the frame from
+   being evicted in between. */
+void frame_release_pinned (void *kpage) {
+  frame_do_free (kpage, true, true);
 }
 
 void frame_remove_entry (void *kpage) {
-  lock_acquire (&frame_lock);
-  frame_do_free (kpage, false);
-  lock_release (&frame_lock);
-}
-
-void frame_do_free (void *kpage, bool free_page) {
-  int loc0 = 0;
-  while (1) {
-    switch (loc0) {
-      case 0:
-        ASSERT (lock_held_by_current_thread(&frame_lock) == true);
-        ASSERT (is_kernel_vaddr(kpage));
-        ASSERT (pg_ofs (kpage) == 0);
-        loc0 = 1;
-        break;
-      case 1: {
-        struct frame_table_entry f_tmp;
-        f_tmp.kpage = kpage;
-        struct hash_elem *h = hash_find (&frame_map, &(f_tmp.helem));
-        if (h == NULL) {
-          PANIC ("There is no such page to be feed in the table");
-        }
-        struct frame_table_entry *f;
-        f = hash_entry(h, struct frame_table_entry, helem);
-        hash_delete (&frame_map, &f->helem);
-        list_remove (&f->lelem);
-        if (free_page) {
-          palloc_free_page(kpage);
-        }
-        free(f);
-        loc0 = 2;
+  frame_do_free (kpage, false, false);
+}
+
+/* Records SPTE as the page table entry for the current thread's
+   mapping of frame KPAGE, which eviction updates in place rather
+   than looking it up in the thread's table.  Must be called
+   before the mapping can be evicted: while the frame is still
+   pinned by its page's load, or for fork(), before
+   frame_unlock_eviction(). */
+void frame_set_page (void *kpage, struct page_entry *spte) {
+  size_t idx = frame_index (kpage);
+  struct frame_map *m;
+
+  lock_acquire (frame_lock_of (idx));
+  m = frame_map_find (&frames[idx], thread_current ());
+  ASSERT (m != NULL && m->upage == spte->upage);
+  m->spte = spte;
+  lock_release (frame_lock_of (idx));
+}
+
+/* Returns the frame table index of user pool page KPAGE. */
+static size_t frame_index (void *kpage) {
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT ((uint8_t *) kpage >= user_base);
+
+  size_t idx = ((uint8_t *) kpage - user_base) / PGSIZE;
+  ASSERT (idx < frame_cnt);
+  return idx;
+}
+
+static struct lock *frame_lock_of (size_t idx) {
+  return &frame_locks[idx & (FRAME_LOCK_CNT - 1)];
+}
+
+static struct condition *frame_cond_of (size_t idx) {
+  return &frame_conds[idx & (FRAME_LOCK_CNT - 1)];
+}
+
+/* Hands frame IDX to the current thread for UPAGE as its only
+   mapping.  The frame starts out pinned until its page is fully
+   loaded. */
+static void frame_claim (size_t idx, void *upage) {
+  struct frame_table_entry *f = &frames[idx];
+
+  ASSERT (lock_held_by_current_thread (frame_lock_of (idx)));
+  ASSERT (f->ref_cnt == 0 && list_empty (&f->more) && !f->shared);
+  f->first.t = thread_current ();
+  f->first.upage = upage;
+  f->first.spte = NULL;
+  f->first.pin_cnt = 1;
+  f->ref_cnt = 1;
+  f->pin_cnt = 1;
+  frame_count (1);
+}
+
+/* Looks up the page at offset OFS of the executable with inode
+   INODE, of which READ_BYTES were read from the file, in the
+   page cache.  If some process already holds it in a frame, adds
+   a mapping of UPAGE by the current thread to that frame, pins
+   it, and returns its kernel address.  Otherwise returns a null
+   pointer and the caller should load the page itself and offer
+   it with frame_share_add(). */
+void* frame_share_get (struct inode *inode, off_t ofs, uint32_t read_bytes,
+                       void *upage) {
+  struct frame_table_entry key, *f;
+  struct frame_map *m;
+  struct hash_elem *e;
+  size_t idx;
+
+  key.inumber = inode_get_inumber (inode);
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  lock_acquire (&share_lock);
+  e = hash_find (&share_map, &key.share_elem);
+  lock_release (&share_lock);
+  if (e == NULL)
+    return NULL;
+
+  m = kmem_cache_alloc (&map_cache);
+  if (m == NULL)
+    return NULL;
+  f = hash_entry (e, struct frame_table_entry, share_elem);
+  idx = f - frames;
+
+  /* The frame may have been evicted and reused since we looked. */
+  lock_acquire (frame_lock_of (idx));
+  if (!f->shared || frame_share_less (&f->share_elem, &key.share_elem, NULL)
+      || frame_share_less (&key.share_elem, &f->share_elem, NULL)) {
+    lock_release (frame_lock_of (idx));
+    kmem_cache_free (&map_cache, m);
+    return NULL;
+  }
+  m->t = thread_current ();
+  m->upage = upage;
+  m->spte = NULL;
+  m->pin_cnt = 1;
+  list_push_back (&f->more, &m->elem);
+  f->ref_cnt++;
+  f->pin_cnt++;
+  lock_release (frame_lock_of (idx));
+  return user_base + idx * PGSIZE;
+}
+
+/* Enters KPAGE, just loaded by the current thread from offset OFS
+   of the executable with inode INODE, into the page cache so
+   that other processes can map it.  Does nothing if another
+   frame already holds that page. */
+void frame_share_add (void *kpage, struct inode *inode, off_t ofs,
+                      uint32_t read_bytes) {
+  size_t idx = frame_index (kpage);
+  struct frame_table_entry *f = &frames[idx];
+
+  lock_acquire (frame_lock_of (idx));
+  ASSERT (f->ref_cnt > 0 && !f->shared);
+  f->inumber = inode_get_inumber (inode);
+  f->ofs = ofs;
+  f->read_bytes = read_bytes;
+  lock_acquire (&share_lock);
+  f->shared = hash_insert (&share_map, &f->share_elem) == NULL;
+  lock_release (&share_lock);
+  lock_release (frame_lock_of (idx));
+}
+
+/* Adds a mapping of frame KPAGE at UPAGE by the current thread,
+   which fork() uses to share its parent's pages.  Must be called
+   between frame_lock_eviction() and frame_unlock_eviction(), so
+   that KPAGE stays put.  Returns false if out of memory. */
+bool frame_map_add (void *kpage, void *upage) {
+  size_t idx = frame_index (kpage);
+  struct frame_table_entry *f = &frames[idx];
+  struct frame_map *m = kmem_cache_alloc (&map_cache);
+
+  ASSERT (lock_held_by_current_thread (&evict_lock));
+  if (m == NULL)
+    return false;
+  m->t = thread_current ();
+  m->upage = upage;
+  m->spte = NULL;
+  m->pin_cnt = 0;
+  lock_acquire (frame_lock_of (idx));
+  ASSERT (f->ref_cnt > 0);
+  list_push_back (&f->more, &m->elem);
+  f->ref_cnt++;
+  lock_release (frame_lock_of (idx));
+  return true;
+}
+
+/* Breaks copy-on-write sharing of frame KPAGE, which the current
+   thread maps at UPAGE.  If no other process maps KPAGE any more
+   it is returned as is.  Otherwise its page is copied into a new
+   frame, the current thread's mapping of KPAGE is dropped, and
+   the new frame is returned, carrying the pins the current
+   thread held on KPAGE.  Either way the frame returned has one
+   more pin than before.  Returns a null pointer if KPAGE was
+   evicted first or if no frame can be had for the copy. */
+void* frame_cow (void *kpage, void *upage) {
+  size_t idx = frame_index (kpage);
+  struct frame_table_entry *f = &frames[idx];
+  struct frame_map *m;
+  unsigned pins;
+  size_t copy_idx;
+  void *copy;
+
+  lock_acquire (frame_lock_of (idx));
+  frame_wait (idx);
+  m = f->ref_cnt > 0 ? frame_map_find (f, thread_current ()) : NULL;
+  if (m == NULL || m->upage != upage) {
+    lock_release (frame_lock_of (idx));
+    return NULL;
+  }
+  m->pin_cnt++;
+  f->pin_cnt++;
+  if (f->ref_cnt == 1) {
+    lock_release (frame_lock_of (idx));
+    return kpage;
+  }
+  lock_release (frame_lock_of (idx));
+
+  copy = frame_allocate (PAL_USER, upage);
+  if (copy == NULL) {
+    vm_frame_eviction_select (kpage);
+    return NULL;
+  }
+  memcpy (copy, kpage, PGSIZE);
+  frame_set_page (copy, m->spte);
+
+  /* The copy is claimed with one pin, which stands for the one
+     taken above.  Any others, say of a system call reading into
+     the page, move over with our mapping. */
+  pins = frame_do_free (kpage, true, true);
+  copy_idx = frame_index (copy);
+  lock_acquire (frame_lock_of (copy_idx));
+  frames[copy_idx].first.pin_cnt += pins;
+  frames[copy_idx].pin_cnt += pins;
+  lock_release (frame_lock_of (copy_idx));
+  return copy;
+}
+
+/* Keeps frames from being evicted until
+   frame_unlock_eviction(), for callers that need a consistent
+   view of where pages are.  Waits for evictions already under
+   way to finish.  The caller must not allocate frames in
+   between. */
+void frame_lock_eviction (void) {
+  lock_acquire (&evict_lock);
+  while (evict_inflight > 0)
+    cond_wait (&evict_idle, &evict_lock);
+}
+
+void frame_unlock_eviction (void) {
+  lock_release (&evict_lock);
+}
+
+/* Removes F from the page cache, if it is there.  Must be called
+   with F's striped lock held. */
+static void frame_unshare (struct frame_table_entry *f) {
+  if (f->shared) {
+    lock_acquire (&share_lock);
+    hash_delete (&share_map, &f->share_elem);
+    lock_release (&share_lock);
+    f->shared = false;
+  }
+}
+
+/* Evicts up to EVICT_BATCH frames and hands the first to the
+   current thread for UPAGE.  This only happens when a fault
+   finds no free frame because the page-out thread has fallen
+   behind.  The first frame is reused as is rather than returned
+   to the page allocator, so no other thread can take it in
+   between; the rest are freed, which lets the next few faults
+   skip eviction.  Returns the frame's kernel address, or a null
+   pointer if the victim's owner is exiting. */
+static void *frame_evict (void *upage) {
+  size_t victims[EVICT_BATCH];
+  size_t n = frame_reclaim (victims, EVICT_BATCH, true);
+  size_t i;
+
+  if (n == 0)
+    return NULL;
+  lock_acquire (frame_lock_of (victims[0]));
+  frame_claim (victims[0], upage);
+  lock_release (frame_lock_of (victims[0]));
+  for (i = 1; i < n; i++)
+    palloc_free_page (user_base + victims[i] * PGSIZE);
+  return user_base + victims[0] * PGSIZE;
+}
+
+/* Evicts up to WANT frames, at most EVICT_BATCH, storing their
+   indexes into VICTIMS, and returns how many.  The frames are
+   left free but not returned to the page allocator.
+
+   Victims are chosen under evict_lock and marked as evicting,
+   after which evict_lock is released and their pages are
+   written out with no lock held, so that other threads can
+   fault, pin, and choose victims of their own meanwhile.
+   vm_page_evict() decides where each page goes, given the page
+   table entry each mapping recorded, so the owners' tables are
+   never searched from here; consecutive
+   page-outs take adjacent swap slots, so a batch is written
+   sequentially.  If MUST is true, the first victim is found
+   however long the clock takes. */
+static size_t frame_reclaim (size_t victims[], size_t want, bool must) {
+  size_t n = 0, i;
+
+  lock_acquire (&evict_lock);
+  for (i = 0; i < EVICT_BATCH && n < want; i++) {
+    size_t idx = pick_frame_to_evict (must && i == 0);
+    bool ok;
+
+    if (idx == SIZE_MAX)
+      break;
+    ok = frame_evict_begin (idx);
+    lock_release (frame_lock_of (idx));
+    if (ok)
+      victims[n++] = idx;
+    else if (i == 0)
+      break;
+  }
+  evict_inflight += n;
+  lock_release (&evict_lock);
+
+  for (i = 0; i < n; i++)
+    frame_evict_finish (victims[i]);
+
+  lock_acquire (&evict_lock);
+  evict_inflight -= n;
+  if (evict_inflight == 0)
+    cond_broadcast (&evict_idle, &evict_lock);
+  lock_release (&evict_lock);
+  return n;
+}
+
+/* Marks frame IDX as being evicted and takes it out of the page
+   cache.  Returns false, doing nothing, if the owner is exiting.
+   Must be called with evict_lock and IDX's striped lock held. */
+static bool frame_evict_begin (size_t idx) {
+  struct frame_table_entry *f = &frames[idx];
+
+  ASSERT (lock_held_by_current_thread (&evict_lock));
+  ASSERT (lock_held_by_current_thread (frame_lock_of (idx)));
+  ASSERT (!f->evicting);
+
+  if (f->first.t->pagedir == (void*)0xcccccccc)
+    return false;
+  frame_unshare (f);
+  f->evicting = true;
+  return true;
+}
+
+/* Takes the page in frame IDX, marked by frame_evict_begin(),
+   away from every process that maps it.  The frame's mappings
+   cannot change while it is evicting, so they are walked
+   without its lock.  Afterward the frame is free, and threads
+   waiting for the eviction to end are woken. */
+static void frame_evict_finish (size_t idx) {
+  struct frame_table_entry *f = &frames[idx];
+  void *victim = user_base + idx * PGSIZE;
+  swap_index_t slot = SWAP_ERROR;
+  struct list_elem *e;
+
+  ASSERT (f->evicting);
+  vm_page_evict (f->first.spte, f->first.t->pagedir, victim, &slot);
+  for (e = list_begin (&f->more); e != list_end (&f->more);
+       e = list_next (e)) {
+    struct frame_map *m = list_entry (e, struct frame_map, elem);
+    vm_page_evict (m->spte, m->t->pagedir, victim, &slot);
+  }
+
+  lock_acquire (frame_lock_of (idx));
+  while (!list_empty (&f->more))
+    kmem_cache_free (&map_cache, list_entry (list_pop_front (&f->more),
+                                             struct frame_map, elem));
+  f->ref_cnt = 0;
+  f->evicting = false;
+  frame_count (-1);
+  cond_broadcast (frame_cond_of (idx), frame_lock_of (idx));
+  lock_release (frame_lock_of (idx));
+}
+
+/* Waits until frame IDX is not being evicted, and returns true
+   if it had to wait.  Must be called with IDX's striped lock
+   held. */
+static bool frame_wait (size_t idx) {
+  bool waited = false;
+
+  ASSERT (lock_held_by_current_thread (frame_lock_of (idx)));
+  while (frames[idx].evicting) {
+    cond_wait (frame_cond_of (idx), frame_lock_of (idx));
+    waited = true;
+  }
+  return waited;
+}
+
+/* If frame KPAGE is being evicted, waits for the eviction to end
+   and returns true; otherwise returns false at once.  A fault on
+   a page whose frame is on its way out calls this, then finds
+   the page wherever it was written to. */
+bool frame_wait_evicted (void *kpage) {
+  size_t idx = frame_index (kpage);
+  bool waited;
+
+  lock_acquire (frame_lock_of (idx));
+  waited = frame_wait (idx);
+  lock_release (frame_lock_of (idx));
+  return waited;
+}
+
+/* Page-out thread.  Sleeps until free frames run short, then
+   evicts frames in batches of up to EVICT_BATCH, releasing
+   evict_lock in between so that faulting threads get a turn,
+   until free_high frames are free.  The frames go back to the
+   page allocator, where the next faults find them without
+   having to wait for a page to be written out. */
+static void frame_pageout (void *aux UNUSED) {
+  for (;;) {
+    size_t victims[EVICT_BATCH];
+    size_t n, i, free_cnt;
+
+    lock_acquire (&pageout_lock);
+    while (frame_free_cnt () >= free_low)
+      cond_wait (&pageout_cond, &pageout_lock);
+    lock_release (&pageout_lock);
+
+    free_cnt = frame_free_cnt ();
+    n = free_cnt < free_high
+        ? frame_reclaim (victims, free_high - free_cnt, false) : 0;
+    for (i = 0; i < n; i++)
+      palloc_free_page (user_base + victims[i] * PGSIZE);
+
+    /* Everything the clock looked at was pinned or in use.  Give
+       the running processes a moment before looking again. */
+    if (n == 0)
+      timer_sleep (1);
+    else if (frame_free_cnt () < free_high)
+      thread_yield ();
+  }
+}
+
+/* Adds DELTA to used_cnt. */
+static void frame_count (int delta) {
+  enum intr_level old_level = intr_disable ();
+  used_cnt += delta;
+  intr_set_level (old_level);
+}
+
+/* Returns the number of frames not mapped by any process. */
+static size_t frame_free_cnt (void) {
+  return frame_cnt - used_cnt;
+}
+
+/* Drops the current thread's mapping of KPAGE.  Once no process
+   maps the frame any more it is marked free, and its page is
+   returned to the page allocator if FREE_PAGE is true; otherwise
+   the caller's page directory still maps it and will free it
+   when destroyed.  A frame that is still shared is instead
+   removed from the caller's page directory, so that it is not
+   freed along with it.
+
+   Pins go with the mapping that took them, so other processes'
+   pins on a shared frame are left alone.  If UNPIN is true, one
+   pin of the caller's is dropped; returns how many the caller
+   still held besides. */
+static unsigned frame_do_free (void *kpage, bool free_page, bool unpin) {
+  ASSERT (is_kernel_vaddr(kpage));
+
+  struct thread *cur = thread_current ();
+  size_t idx = frame_index (kpage);
+  struct frame_table_entry *f = &frames[idx];
+  struct frame_map *m = NULL;
+  unsigned pins;
+  void *upage;
+  bool waited;
+
+  lock_acquire (frame_lock_of (idx));
+  waited = frame_wait (idx);
+  if (f->ref_cnt == 0 && waited) {
+    /* Evicted while we waited: nothing of ours is left. */
+    lock_release (frame_lock_of (idx));
+    return 0;
+  }
+  if (f->ref_cnt == 0)
+    PANIC ("There is no such page to be feed in the table");
+
+  /* Find our mapping.  If it is FIRST, promote another in its
+     place. */
+  if (f->first.t == cur) {
+    upage = f->first.upage;
+    pins = f->first.pin_cnt;
+    if (!list_empty (&f->more)) {
+      m = list_entry (list_pop_front (&f->more), struct frame_map, elem);
+      f->first.t = m->t;
+      f->first.upage = m->upage;
+      f->first.spte = m->spte;
+      f->first.pin_cnt = m->pin_cnt;
+    }
+  } else {
+    struct list_elem *e;
+
+    for (e = list_begin (&f->more); e != list_end (&f->more);
+         e = list_next (e))
+      if (list_entry (e, struct frame_map, elem)->t == cur)
         break;
-      }
-      case 2:
-        return;
+    if (e == list_end (&f->more) && waited) {
+      /* Evicted and reused while we waited. */
+      lock_release (frame_lock_of (idx));
+      return 0;
     }
+    if (e == list_end (&f->more))
+      PANIC ("Frame is not mapped by this process");
+    m = list_entry (e, struct frame_map, elem);
+    upage = m->upage;
+    pins = m->pin_cnt;
+    list_remove (e);
+  }
+  kmem_cache_free (&map_cache, m);
+  f->pin_cnt -= pins;
+  if (unpin) {
+    ASSERT (pins > 0);
+    pins--;
   }
+
+  if (--f->ref_cnt > 0) {
+    lock_release (frame_lock_of (idx));
+    pagedir_clear_page (cur->pagedir, upage);
+    return pins;
+  }
+  frame_unshare (f);
+  ASSERT (f->pin_cnt == 0);
+  frame_count (-1);
+  lock_release (frame_lock_of (idx));
+
+  if (free_page)
+    palloc_free_page (kpage);
+  return pins;
 }
 
-struct frame_table_entry* clock_frame_next(void) {
-    if (list_empty(&frame_list))
-        PANIC("Empty Frame table. Note a leak in somewhere");
+/* Returns T's mapping of frame F, or a null pointer if T does
+   not map it.  Must be called with F's striped lock held. */
+static struct frame_map *frame_map_find (struct frame_table_entry *f,
+                                         struct thread *t) {
+  struct list_elem *e;
 
-    clock_ptr = (clock_ptr == NULL || clock_ptr == list_end(&frame_list)) ? list_begin(&frame_list) : list_next(clock_ptr);
-    return list_entry(clock_ptr, struct frame_table_entry, lelem);
+  if (f->first.t == t)
+    return &f->first;
+  for (e = list_begin (&f->more); e != list_end (&f->more); e = list_next (e)) {
+    struct frame_map *m = list_entry (e, struct frame_map, elem);
+    if (m->t == t)
+      return m;
+  }
+  return NULL;
 }
 
-struct frame_table_entry* pick_frame_to_evict(uint32_t *pagedir) {
-  int loc0 = 0;
-  size_t n;
-  size_t it = 0;
-  struct frame_table_entry *e = NULL;
+/* Returns true if the page in frame IDX was referenced since
+   the bits were last cleared, clearing them.  Both the user
+   mapping and the kernel alias are checked, in the page
+   directory of every process that maps the frame. */
+static bool frame_test_and_clear_accessed (size_t idx) {
+  struct frame_table_entry *f = &frames[idx];
+  void *kpage = user_base + idx * PGSIZE;
+  struct frame_map *m = &f->first;
+  struct list_elem *e = list_begin (&f->more);
+  bool accessed = false;
 
-  while (1) {
-    switch (loc0) {
-      case 0:
-        n = hash_size(&frame_map);
-        if (n == 0) {
-          PANIC("Empty Frame table. Note a leak in somewhere");
-        }
-        loc0 = 1;
-        break;
-        
-      case 1:
-        if (it > n + n) {
-          loc0 = 3;
-        } else {
-          loc0 = 2;
-        }
-        break;
-        
-      case 2:
-        e = clock_frame_next();
-        if (e->pinned) {
-          it++;
-          loc0 = 1;
-        } else if (pagedir_is_accessed(pagedir, e->upage)) {
-          pagedir_set_accessed(pagedir, e->upage, false);
-          it++;
-          loc0 = 1;
-        } else {
-          return e;
-        }
-        break;
-        
-      case 3:
-        PANIC("Unable fram eviction. Not enough memory\n");
-        break;
+  for (;;) {
+    uint32_t *pd = m->t->pagedir;
+
+    if (pagedir_is_accessed (pd, m->upage) || pagedir_is_accessed (pd, kpage)) {
+      pagedir_set_accessed (pd, m->upage, false);
+      pagedir_set_accessed (pd, kpage, false);
+      accessed = true;
     }
+    if (e == list_end (&f->more))
+      break;
+    m = list_entry (e, struct frame_map, elem);
+    e = list_next (e);
   }
+  return accessed;
 }
 
-static void vm_frame_set_pinned(void *kpage, bool new_value) {
-  int loc0 = 0;
-  struct frame_table_entry f_tmp;
-  struct hash_elem *h = NULL;
-  struct frame_table_entry *f = NULL;
-
-  while (1) {
-    switch (loc0) {
-      case 0:
-        lock_acquire(&frame_lock);
-        loc0 = 1;
-        break;       
-      case 1:
-        f_tmp.kpage = kpage;
-        h = hash_find(&frame_map, &(f_tmp.helem));
-        if (h == NULL) {
-          loc0 = 3;
-        } else {
-          loc0 = 2;
-        }
-        break;      
-      case 2:
-        f = hash_entry(h, struct frame_table_entry, helem);
-        f->pinned = new_value;
-        loc0 = 4;
-        break;   
-      case 3:
-        PANIC("No such frame to be pinned/unpinned");
-        break;   
-      case 4:
-        lock_release(&frame_lock);
-        return;
+/* Chooses a frame to evict with a two-handed clock and returns
+   its index with its striped lock held.  The front hand clears
+   accessed bits; the back hand trails it by clock_spread frames
+   and takes the first unpinned frame that has not been touched
+   since the front hand passed.  If a whole sweep finds none, the
+   first unpinned frame the back hand saw is taken, so a fault
+   costs at most frame_cnt + clock_spread steps.
+
+   If MUST is false, the caller only wants an extra victim: the
+   search gives up after clock_spread steps, without falling
+   back, and returns SIZE_MAX.  Must be called with evict_lock
+   held. */
+static size_t pick_frame_to_evict (bool must) {
+  size_t steps = must ? frame_cnt + clock_spread : clock_spread;
+  size_t fallback = SIZE_MAX;
+  size_t it;
+
+  ASSERT (lock_held_by_current_thread (&evict_lock));
+  if (frame_cnt == 0)
+    PANIC("Empty Frame table. Note a leak in somewhere");
+  for (it = 0; it < steps; it++) {
+    size_t front = (clock_hand + clock_spread) % frame_cnt;
+    size_t back = clock_hand;
+    struct lock *l;
+
+    clock_hand = clock_hand + 1 < frame_cnt ? clock_hand + 1 : 0;
+
+    l = frame_lock_of (front);
+    lock_acquire (l);
+    if (frames[front].ref_cnt > 0 && !frames[front].evicting)
+      frame_test_and_clear_accessed (front);
+    lock_release (l);
+
+    l = frame_lock_of (back);
+    lock_acquire (l);
+    if (frames[back].ref_cnt > 0 && frames[back].pin_cnt == 0
+        && !frames[back].evicting) {
+      if (!frame_test_and_clear_accessed (back))
+        return back;
+      if (fallback == SIZE_MAX)
+        fallback = back;
     }
+    lock_release (l);
+  }
+
+  if (!must)
+    return SIZE_MAX;
+
+  /* Everything was referenced again before the back hand got to
+     it.  Fall back to plain FIFO order. */
+  if (fallback != SIZE_MAX) {
+    lock_acquire (frame_lock_of (fallback));
+    if (frames[fallback].ref_cnt > 0 && frames[fallback].pin_cnt == 0
+        && !frames[fallback].evicting)
+      return fallback;
+    lock_release (frame_lock_of (fallback));
+  }
+  PANIC("Unable fram eviction. Not enough memory\n");
+}
+
+/* Pinning only takes the frame's own striped lock, so it does
+   not wait for eviction of unrelated frames.  Pins are counted
+   per mapping, since every process that shares a frame may pin
+   it, and a process can only unpin what it pinned.  Returns
+   false, doing nothing, if the current thread no longer maps
+   KPAGE because it was evicted first. */
+static bool vm_frame_set_pinned(void *kpage, bool new_value) {
+  size_t idx = frame_index (kpage);
+  struct frame_table_entry *f = &frames[idx];
+  struct frame_map *m;
+
+  lock_acquire (frame_lock_of (idx));
+  frame_wait (idx);
+  m = f->ref_cnt > 0 ? frame_map_find (f, thread_current ()) : NULL;
+  if (m == NULL) {
+    /* Evicted, and maybe reused by another process. */
+    lock_release (frame_lock_of (idx));
+    return false;
   }
+  if (new_value) {
+    m->pin_cnt++;
+    f->pin_cnt++;
+  } else if (m->pin_cnt > 0) {
+    m->pin_cnt--;
+    f->pin_cnt--;
+  }
+  lock_release (frame_lock_of (idx));
+  return true;
 }
 
 
@@ -281,46 +832,31 @@ void vm_frame_eviction_select (void* kpage) {
   vm_frame_set_pinned (kpage, false);
 }
 
-void vm_frame_pin_toggle (void* kpage) {
-  vm_frame_set_pinned (kpage, true);
-}
-
-static unsigned frame_hash_func(const struct hash_elem *elem, void *aux UNUSED) {
-  struct frame_table_entry *entry;
-  entry = hash_entry(elem, struct frame_table_entry, helem);
-  // we use a variation of the DJB2 hash algorithm to minimize hash collisions
-  // DJB2 algorithm generates hash values by multiplying by 33 and adding the values together
-  // algorithm is known to be simple and effective at generating hash values
-  // this implementation uses a variation of DJB2 by using 31
-  // to avoid hash collisions, the hash func considers all bits of the input to generate the hash value
-  // we process the kpage pointer value byte by byte to generate the hash value
-  // loc0 variable is used as an index in the iteration, accessing each byte of the ptr array
-  // while loop traverses all bytes of kpage and updates the hash value.
-  // byte is added to the hash value via an XOR operation, and the hash value is updated by multiplying it by 31
-  unsigned int hash = 0;
-  unsigned char *ptr = (unsigned char *)&entry->kpage;
-  int loc0 = 0;
-  while (loc0 < sizeof entry->kpage) {
-    hash = (hash * 31) ^ ptr[loc0];
-    loc0++;
-  }
-  return hash;
+/* Pins KPAGE, which the current thread maps.  Returns false if
+   it was evicted first. */
+bool vm_frame_pin_toggle (void* kpage) {
+  return vm_frame_set_pinned (kpage, true);
 }
 
-static bool frame_less_func(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED) {
-  struct frame_table_entry *a_entry;
-  struct frame_table_entry *b_entry;
+static unsigned frame_share_hash (const struct hash_elem *e, void *aux UNUSED) {
+  const struct frame_table_entry *f
+    = hash_entry (e, struct frame_table_entry, share_elem);
+  unsigned h = hash_int (f->inumber);
 
-  int loc0 = 0;
-  while (1) {
-    switch (loc0) {
-      case 0:
-        a_entry = hash_entry(a, struct frame_table_entry, helem);
-        b_entry = hash_entry(b, struct frame_table_entry, helem);
-        loc0 = 1;
-        break;
-      case 1:
-        return a_entry->kpage < b_entry->kpage;
-    }
-  }
-}
\ No newline at end of file
+  h = h * 31 + hash_int (f->ofs);
+  return h * 31 + hash_int (f->read_bytes);
+}
+
+static bool frame_share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                              void *aux UNUSED) {
+  const struct frame_table_entry *a
+    = hash_entry (a_, struct frame_table_entry, share_elem);
+  const struct frame_table_entry *b
+    = hash_entry (b_, struct frame_table_entry, share_elem);
+
+  if (a->inumber != b->inumber)
+    return a->inumber < b->inumber;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
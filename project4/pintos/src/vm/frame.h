@@ -2,15 +2,27 @@
 #define VM_FRAME_H
 #include "threads/synch.h"
 #include "threads/palloc.h"
-#include <hash.h>
-#include "lib/kernel/hash.h"
+#include "filesys/off_t.h"
+
+struct inode;
+struct page_entry;
 
 void frame_management_init (void);
+void frame_pageout_init (void);
 void* frame_allocate (enum palloc_flags flags, void *upage);
+void* frame_try_allocate (enum palloc_flags flags, void *upage);
 void frame_release (void*);
+void frame_release_pinned (void*);
 void frame_remove_entry (void*);
-void frame_pin_toggle (void* kpage);
-void frame_eviction_select (void* kpage);
+void frame_set_page (void *kpage, struct page_entry *);
+void* frame_share_get (struct inode *, off_t, uint32_t read_bytes, void *upage);
+void frame_share_add (void *kpage, struct inode *, off_t, uint32_t read_bytes);
+bool frame_map_add (void *kpage, void *upage);
+void* frame_cow (void *kpage, void *upage);
+void frame_lock_eviction (void);
+void frame_unlock_eviction (void);
+bool frame_wait_evicted (void *kpage);
+bool vm_frame_pin_toggle (void* kpage);
+void vm_frame_eviction_select (void* kpage);
 
 #endif 
-
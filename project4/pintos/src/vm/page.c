@@ -1,9 +1,12 @@
 #include <hash.h>
+#include <stdio.h>
 #include <string.h>
 #include "lib/kernel/hash.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/page.h"
@@ -13,6 +16,60 @@
 static unsigned spte_hash_func(const struct hash_elem *elem, void *aux);
 static bool spte_less_func(const struct hash_elem *, const struct hash_elem *, void *aux);
 static void spte_destroy_func(struct hash_elem *elem, void *aux);
+static bool page_load(struct page_table *supt, uint32_t *pagedir, void *upage, bool prefetch);
+static void page_drop_swap_copy(struct page_entry *);
+static bool page_pin_frame(struct page_entry *);
+static struct page_entry *page_find(struct page_table *supt, void *upage);
+static struct vma *vma_find(struct page_table *supt, void *upage);
+static struct page_entry *vma_populate(struct page_table *supt, struct vma *, void *upage);
+static bool vma_less(const struct list_elem *, const struct list_elem *, void *aux);
+
+/* Returns SUPT as the struct page_table it is. */
+static inline struct page_table *page_table_of(struct supplemental_page_table *supt) {
+  return (struct page_table *) supt;
+}
+
+/* Bounds on the number of pages loaded ahead of a fault. */
+#define FAULT_AROUND_MIN 1
+#define FAULT_AROUND_MAX 16
+
+/* Fault-around statistics. */
+static long long fault_around_cnt;      /* Faults that loaded ahead. */
+static long long prefetch_cnt;          /* Pages loaded ahead of use. */
+
+/* A page of zeros, mapped read-only at every ALL_ZERO page that
+   has been read but not yet written.  It comes from the kernel
+   pool, so it is never in the frame table and never evicted. */
+static void *zero_page;
+static long long zero_map_cnt;          /* Reads that mapped it. */
+
+/* Evictions of pages whose copy in swap was still current. */
+static long long swap_reuse_cnt;
+
+/* Cache of page_entries, which come and go with every mapping. */
+static struct kmem_cache spte_cache;
+
+/* A range of pages backed by a file, such as an ELF segment or
+   an mmap()ed file, of which READ_BYTES are read from FILE at
+   OFFSET and the rest are zero.  Rather than a page_entry for
+   each page up front, a page gets its page_entry the first
+   time it is looked up.  The VMAs of a process never overlap
+   and are few, so they are kept in a list sorted by address. */
+struct vma
+  {
+    struct list_elem elem;    /* In page_table's VMAS. */
+    uint8_t *start, *end;     /* Page-aligned bounds, END exclusive. */
+    struct file *file;
+    off_t offset;
+    uint32_t read_bytes;
+    bool writable;
+    bool is_mmap;             /* See page_entry's IS_MMAP. */
+  };
+
+void vm_page_init(void) {
+  zero_page = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+  kmem_cache_init(&spte_cache, "page_entry", sizeof(struct page_entry));
+}
 
 struct page_table* supplemental_table_create(void) {
   struct page_table *supt = NULL;
@@ -24,6 +81,9 @@ struct page_table* supplemental_table_create(void) {
     }
     if (sizeof(*supt) > 0) {
       hash_init(&supt->page_map, spte_hash_func, spte_less_func, NULL);
+      list_init(&supt->vmas);
+      supt->fault_next = NULL;
+      supt->fault_window = FAULT_AROUND_MIN;
       break;
     }
   }
@@ -38,6 +98,9 @@ void supplemental_table_destroy(struct page_table *supt) {
     ASSERT(supt != NULL);
     if (hash_size(&supt->page_map) >= 0) {
       hash_destroy(&supt->page_map, spte_destroy_func);
+      while (!list_empty(&supt->vmas)) {
+        free(list_entry(list_pop_front(&supt->vmas), struct vma, elem));
+      }
       if (true) {
         free(supt);
         break;
@@ -55,7 +118,7 @@ bool supplemental_frame_install(struct page_table *supt, void *upage, void *kpag
   while (!done) {
     switch (loc) {
       case 0:
-        spte = (struct page_entry *) malloc(sizeof(struct page_entry));
+        spte = kmem_cache_alloc(&spte_cache);
         if (spte == NULL) {
           return false;
         }
@@ -66,7 +129,11 @@ bool supplemental_frame_install(struct page_table *supt, void *upage, void *kpag
         spte->kpage = kpage;
         spte->status = ON_FRAME;
         spte->dirty = false;
-        spte->swap_index = -1;
+        spte->swap_index = SWAP_ERROR;
+        spte->file = NULL;
+        spte->is_mmap = false;
+        spte->writable = true;
+        spte->cow = false;
         loc = 2;
         break;
 
@@ -76,7 +143,7 @@ bool supplemental_frame_install(struct page_table *supt, void *upage, void *kpag
           if (spte->status == ON_FRAME && !spte->dirty) {
             loc = 3;
           } else {
-            free(spte);
+            kmem_cache_free(&spte_cache, spte);
             return false;
           }
         } else {
@@ -84,9 +151,10 @@ bool supplemental_frame_install(struct page_table *supt, void *upage, void *kpag
         }
         break;
       case 3:
+        frame_set_page(kpage, spte);
         return true;
       case 4:
-        free(spte);
+        kmem_cache_free(&spte_cache, spte);
         done = true;
         break;
     }
@@ -102,7 +170,7 @@ bool supplemental_zeropage_install(struct page_table *supt, void *upage) {
   while (!done) {
     switch (loc) {
       case 0:
-        spte = (struct page_entry *) malloc(sizeof(struct page_entry));
+        spte = kmem_cache_alloc(&spte_cache);
         if (spte == NULL) {
           return false;
         }
@@ -113,6 +181,11 @@ bool supplemental_zeropage_install(struct page_table *supt, void *upage) {
         spte->kpage = NULL;
         spte->status = ALL_ZERO;
         spte->dirty = false;
+        spte->swap_index = SWAP_ERROR;
+        spte->file = NULL;
+        spte->is_mmap = false;
+        spte->writable = true;
+        spte->cow = false;
         loc = 2;
         break;
       case 2:
@@ -121,7 +194,7 @@ bool supplemental_zeropage_install(struct page_table *supt, void *upage) {
           if (spte->status == ALL_ZERO && spte->kpage == NULL) {
             loc = 3;
           } else {
-            free(spte);
+            kmem_cache_free(&spte_cache, spte);
             return false;
           }
         } else {
@@ -186,7 +259,7 @@ bool supplemental_filesys_install(struct page_table *supt, void *upage, struct f
   while (!done) {
     switch (loc) {
       case 0:
-        spte = (struct page_entry *) malloc(sizeof(struct page_entry));
+        spte = kmem_cache_alloc(&spte_cache);
         if (spte == NULL) {
           return false;
         }
@@ -197,11 +270,14 @@ bool supplemental_filesys_install(struct page_table *supt, void *upage, struct f
         spte->kpage = NULL;
         spte->status = FROM_FILESYS;
         spte->dirty = false;
+        spte->swap_index = SWAP_ERROR;
         spte->file = file;
         spte->file_offset = offset;
         spte->read_bytes = read_bytes;
         spte->zero_bytes = zero_bytes;
         spte->writable = writable;
+        spte->is_mmap = false;
+        spte->cow = false;
         loc = 2;
         break;
       case 2:
@@ -234,24 +310,165 @@ bool supplemental_filesys_install(struct page_table *supt, void *upage, struct f
   return false;
 }
 
+/* Like supplemental_filesys_install(), for a writable page of a
+   memory-mapped FILE.  On eviction, dirty contents of the page
+   are written back to FILE rather than to swap. */
+bool supplemental_mmap_install(struct page_table *supt, void *upage, struct file *file,
+    off_t offset, uint32_t read_bytes, uint32_t zero_bytes) {
+  if (!supplemental_filesys_install(supt, upage, file, offset, read_bytes, zero_bytes, true))
+    return false;
+  supplemental_page_lookup(supt, upage)->is_mmap = true;
+  return true;
+}
+
+/* Maps the pages from START on lazily: READ_BYTES from FILE at
+   OFFSET, then ZERO_BYTES of zeros.  READ_BYTES + ZERO_BYTES
+   must be a multiple of PGSIZE.  IS_MMAP is true for mmap()ed
+   files.  Costs the same however many pages the range spans.
+   Returns false if the range leaves user space or overlaps pages
+   already mapped, or if out of memory. */
+bool supplemental_vma_install(struct supplemental_page_table *supt_, void *start,
+    struct file *file, off_t offset, uint32_t read_bytes, uint32_t zero_bytes,
+    bool writable, bool is_mmap) {
+  struct page_table *supt = page_table_of(supt_);
+  uint8_t *end = (uint8_t *) start + read_bytes + zero_bytes;
+  size_t page_cnt = (read_bytes + zero_bytes) / PGSIZE;
+  struct list_elem *e;
+  struct vma *vma;
+
+  ASSERT(pg_ofs(start) == 0);
+  ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
+  if (page_cnt == 0 || end <= (uint8_t *) start || end > (uint8_t *) PHYS_BASE) {
+    return false;
+  }
+
+  for (e = list_begin(&supt->vmas); e != list_end(&supt->vmas); e = list_next(e)) {
+    vma = list_entry(e, struct vma, elem);
+    if (vma->start < end && (uint8_t *) start < vma->end) {
+      return false;
+    }
+  }
+
+  /* Pages outside any VMA, such as the stack, only have their
+     page_entry.  Check whichever is fewer, those or the range. */
+  if (hash_size(&supt->page_map) < page_cnt) {
+    struct hash_iterator i;
+
+    hash_first(&i, &supt->page_map);
+    while (hash_next(&i)) {
+      uint8_t *upage = hash_entry(hash_cur(&i), struct page_entry, elem)->upage;
+      if (upage >= (uint8_t *) start && upage < end) {
+        return false;
+      }
+    }
+  } else {
+    uint8_t *upage;
+
+    for (upage = start; upage < end; upage += PGSIZE) {
+      if (page_find(supt, upage) != NULL) {
+        return false;
+      }
+    }
+  }
+
+  vma = malloc(sizeof *vma);
+  if (vma == NULL) {
+    return false;
+  }
+  vma->start = start;
+  vma->end = end;
+  vma->file = file;
+  vma->offset = offset;
+  vma->read_bytes = read_bytes;
+  vma->writable = writable;
+  vma->is_mmap = is_mmap;
+  list_insert_ordered(&supt->vmas, &vma->elem, vma_less, NULL);
+  return true;
+}
+
+/* Removes the VMA that starts at START.  Pages of it that were
+   already looked up keep their page_entry. */
+void supplemental_vma_remove(struct supplemental_page_table *supt_, void *start) {
+  struct page_table *supt = page_table_of(supt_);
+  struct vma *vma = vma_find(supt, start);
+
+  ASSERT(vma != NULL && vma->start == start);
+  list_remove(&vma->elem);
+  free(vma);
+}
+
+/* Returns the page_entry of PAGE, making it first if PAGE lies
+   in a VMA and has none yet.  Returns a null pointer if PAGE is
+   not mapped, or if out of memory. */
 struct page_entry* supplemental_page_lookup(struct page_table *supt, void *page) {
+  struct page_entry *spte = page_find(supt, page);
+  struct vma *vma;
+
+  if (spte != NULL) {
+    return spte;
+  }
+  vma = vma_find(supt, page);
+  if (vma == NULL) {
+    return NULL;
+  }
+  return vma_populate(supt, vma, page);
+}
+
+/* Returns the page_entry of UPAGE, or a null pointer if it has
+   none yet. */
+static struct page_entry *page_find(struct page_table *supt, void *upage) {
   struct page_entry spte_temp;
-  spte_temp.upage = page;
-  struct hash_elem *elem = NULL;
-  int loc = 0;
-  while (true) {
-    switch (loc) {
-      case 0:
-        elem = hash_find(&supt->page_map, &spte_temp.elem);
-        if (elem == NULL) {
-          return NULL;
-        }
-        loc = 1;
-        break;
-      case 1:
-        return hash_entry(elem, struct page_entry, elem);
+  struct hash_elem *elem;
+
+  spte_temp.upage = upage;
+  elem = hash_find(&supt->page_map, &spte_temp.elem);
+  return elem != NULL ? hash_entry(elem, struct page_entry, elem) : NULL;
+}
+
+/* Returns the VMA that contains UPAGE, or a null pointer. */
+static struct vma *vma_find(struct page_table *supt, void *upage) {
+  struct list_elem *e;
+
+  for (e = list_begin(&supt->vmas); e != list_end(&supt->vmas); e = list_next(e)) {
+    struct vma *vma = list_entry(e, struct vma, elem);
+    if ((uint8_t *) upage < vma->start) {
+      break;
+    }
+    if ((uint8_t *) upage < vma->end) {
+      return vma;
     }
   }
+  return NULL;
+}
+
+/* Makes the page_entry for UPAGE, a page of VMA, and returns it.
+   A writable page that lies wholly past the end of the file
+   data, such as one of bss, starts out ALL_ZERO, so that reading
+   it maps the zero page.  Returns a null pointer if out of
+   memory. */
+static struct page_entry *vma_populate(struct page_table *supt, struct vma *vma, void *upage) {
+  size_t ofs = (uint8_t *) upage - vma->start;
+  uint32_t read_bytes = 0;
+  bool success;
+
+  if (vma->read_bytes > ofs) {
+    read_bytes = vma->read_bytes - ofs < PGSIZE ? vma->read_bytes - ofs : PGSIZE;
+  }
+
+  if (read_bytes == 0 && vma->writable && !vma->is_mmap) {
+    success = supplemental_zeropage_install(supt, upage);
+  } else if (vma->is_mmap) {
+    success = supplemental_mmap_install(supt, upage, vma->file, vma->offset + ofs,
+                                        read_bytes, PGSIZE - read_bytes);
+  } else {
+    success = supplemental_filesys_install(supt, upage, vma->file, vma->offset + ofs,
+                                           read_bytes, PGSIZE - read_bytes, vma->writable);
+  }
+  return success ? page_find(supt, upage) : NULL;
+}
+
+static bool vma_less(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
+  return list_entry(a, struct vma, elem)->start < list_entry(b, struct vma, elem)->start;
 }
 
 bool supplemental_entry_exist(struct page_table *supt, void *page) {
@@ -261,11 +478,11 @@ bool supplemental_entry_exist(struct page_table *supt, void *page) {
   while (true) {
     switch (loc) {
       case 0:
-        spte = supplemental_page_lookup(supt, page);
+        spte = page_find(supt, page);
         loc = 1;
         break;
       case 1:
-        if (spte == NULL) {
+        if (spte == NULL && vma_find(supt, page) == NULL) {
           result = false;
         } else {
           result = true;
@@ -307,6 +524,90 @@ bool supplemental_dirty_set(struct page_table *supt, void *page, bool value) {
 static bool vm_page_load_from_filesys(struct page_entry *, void *);
 
 bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage) {
+  return page_load(supt, pagedir, upage, false);
+}
+
+/* Resolves a page fault on UPAGE.  If the page came from a file
+   or from swap, also loads up to supt->fault_window pages after
+   it that are backed by the same object, as long as free frames
+   remain, so that a sequential scan takes one fault per window
+   rather than one per page.  The window doubles while faults
+   keep landing just past the previous window and falls back to
+   FAULT_AROUND_MIN on any other fault.  A read fault on an
+   ALL_ZERO page maps the shared zero page instead of a frame;
+   WRITE says whether the fault was a write. */
+bool vm_page_fault(struct supplemental_page_table *supt_, uint32_t *pagedir, void *upage, bool write) {
+  struct page_table *supt = page_table_of(supt_);
+  struct page_entry *spte = supplemental_page_lookup(supt, upage);
+  enum page_status status;
+  struct file *file;
+  size_t i;
+
+  if (spte == NULL) {
+    return false;
+  }
+  status = spte->status;
+
+  /* Reading a page that was never written needs no frame of its
+     own until the first write, which vm_page_cow() handles. */
+  if (status == ALL_ZERO && !write) {
+    ASSERT(spte->kpage == NULL);
+    if (!pagedir_set_page(pagedir, upage, zero_page, false)) {
+      return false;
+    }
+    spte->kpage = zero_page;
+    zero_map_cnt++;
+    return true;
+  }
+
+  file = spte->file;
+  if (!page_load(supt, pagedir, upage, false)) {
+    return false;
+  }
+  if (status != FROM_FILESYS && status != ON_SWAP) {
+    return true;
+  }
+
+  if (upage == supt->fault_next) {
+    supt->fault_window *= 2;
+    if (supt->fault_window > FAULT_AROUND_MAX)
+      supt->fault_window = FAULT_AROUND_MAX;
+  } else {
+    supt->fault_window = FAULT_AROUND_MIN;
+  }
+
+  fault_around_cnt++;
+  for (i = 1; i <= supt->fault_window; i++) {
+    void *next = upage + i * PGSIZE;
+    struct page_entry *n;
+
+    if (!is_user_vaddr(next))
+      break;
+    n = supplemental_page_lookup(supt, next);
+    if (n == NULL || n->status != status
+        || (status == FROM_FILESYS && n->file != file))
+      break;
+    if (!page_load(supt, pagedir, next, true))
+      break;
+    prefetch_cnt++;
+  }
+  supt->fault_next = upage + i * PGSIZE;
+  return true;
+}
+
+/* Prints fault-around statistics. */
+void vm_page_print_stats(void) {
+  printf("VM: %lld faults loaded %lld pages ahead\n",
+         fault_around_cnt, prefetch_cnt);
+  printf("VM: %lld reads mapped the zero page\n", zero_map_cnt);
+  printf("VM: %lld evictions reused a swap copy\n", swap_reuse_cnt);
+}
+
+/* Brings UPAGE into a frame and maps it in PAGEDIR.  If PREFETCH
+   is true the page has not been asked for yet: it only takes a
+   free frame, never evicts for one, and is left looking unused
+   to the clock. */
+static bool page_load(struct page_table *supt, uint32_t *pagedir, void *upage, bool prefetch) {
   struct page_entry *spte;
   void *frame_page = NULL;
   bool writable = true;
@@ -325,13 +626,43 @@ bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage) {
 
       case 1:
         if (spte->status == ON_FRAME) {
-          return true;
+          /* The page-out thread unmaps a page before it changes
+             status and then clears kpage, without holding any lock
+             we could take.  A page that is ON_FRAME but unmapped is
+             on its way out: wait, then look again and load it from
+             wherever it went. */
+          void *kpage = spte->kpage;
+
+          if (pagedir_get_page(pagedir, upage) != NULL) {
+            return true;
+          }
+          if (kpage != NULL) {
+            frame_wait_evicted(kpage);
+          }
+          break;
+        }
+        if (spte->status == ALL_ZERO && spte->kpage != NULL) {
+          /* Trade the zero page for a frame of its own. */
+          pagedir_clear_page(pagedir, upage);
+          spte->kpage = NULL;
         }
         loc = 2;
         break;
 
       case 2:
-        frame_page = frame_allocate(PAL_USER, upage);
+        /* Read-only executable pages may already be in memory on
+           behalf of another process running the same program. */
+        if (spte->status == FROM_FILESYS && !spte->writable) {
+          frame_page = frame_share_get(file_get_inode(spte->file), spte->file_offset,
+                                       spte->read_bytes, upage);
+          if (frame_page != NULL) {
+            writable = false;
+            loc = 4;
+            break;
+          }
+        }
+        frame_page = prefetch ? frame_try_allocate(PAL_USER, upage)
+                              : frame_allocate(PAL_USER, upage);
         if (frame_page == NULL) {
           return false;
         }
@@ -345,7 +676,9 @@ bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage) {
         } else if (spte->status == ON_FRAME) {
           loc = 4;
         } else if (spte->status == ON_SWAP) {
-          swap_page_in(spte->swap_index, frame_page);
+          /* Keep the slot: until the page is written to, it
+             holds a copy that eviction can fall back on. */
+          swap_page_read(spte->swap_index, frame_page);
           loc = 4;
         } else if (spte->status == FROM_FILESYS) {
           loc = 5;
@@ -356,7 +689,7 @@ bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage) {
 
       case 4:
         if (!pagedir_set_page(pagedir, upage, frame_page, writable)) {
-          frame_release(frame_page);
+          frame_release_pinned(frame_page);
           return false;
         }
         loc = 6;
@@ -364,17 +697,25 @@ bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage) {
 
       case 5:
         if (!vm_page_load_from_filesys(spte, frame_page)) {
-          frame_release(frame_page);
+          frame_release_pinned(frame_page);
           return false;
         }
         writable = spte->writable;
+        if (!writable) {
+          frame_share_add(frame_page, file_get_inode(spte->file), spte->file_offset,
+                          spte->read_bytes);
+        }
         loc = 4;
         break;
 
       case 6:
+        frame_set_page(frame_page, spte);
         spte->kpage = frame_page;
         spte->status = ON_FRAME;
         pagedir_set_dirty(pagedir, frame_page, false);
+        if (prefetch) {
+          pagedir_set_accessed(pagedir, frame_page, false);
+        }
         vm_frame_eviction_select(frame_page);
         done = true;
         return true;
@@ -385,6 +726,206 @@ bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage) {
 }
 
 
+/* Unmaps SPTE's page, held in frame KPAGE, from PAGEDIR so that
+   the frame can be reused, and saves its contents where the next
+   fault on the page will find them.  A page that still matches the
+   file it was loaded from is dropped and read again from that
+   file; a dirty page of a memory-mapped file is written back to
+   the file.  Only anonymous pages and modified pages of the
+   executable go to swap, and a page that was swapped in and has
+   not been written since still has its old slot, so it is
+   dropped without writing it again.
+
+   KPAGE may be shared copy-on-write, in which case this is
+   called once for each mapping with the same *SLOT, initially
+   SWAP_ERROR.  The first mapping that needs swap writes the page
+   and stores its slot there; the others share that slot. */
+void vm_page_evict(struct page_entry *spte, uint32_t *pagedir, void *kpage, swap_index_t *slot) {
+  void *upage = spte->upage;
+  bool pte_dirty, is_dirty;
+
+  ASSERT(spte->status == ON_FRAME && spte->kpage == kpage);
+
+  pagedir_clear_page(pagedir, upage);
+  spte->cow = false;
+  pte_dirty = pagedir_is_dirty(pagedir, upage) || pagedir_is_dirty(pagedir, kpage);
+  is_dirty = spte->dirty || pte_dirty;
+  if (pte_dirty) {
+    page_drop_swap_copy(spte);
+  }
+
+  if (spte->swap_index != SWAP_ERROR) {
+    spte->status = ON_SWAP;
+    spte->kpage = NULL;
+    swap_reuse_cnt++;
+  } else if (spte->file != NULL && (!is_dirty || spte->is_mmap)) {
+    if (is_dirty && file_write_at(spte->file, kpage, spte->read_bytes, spte->file_offset)
+                    != (off_t) spte->read_bytes) {
+      PANIC("File write failed");
+    }
+    spte->status = FROM_FILESYS;
+    spte->kpage = NULL;
+    spte->dirty = false;
+  } else {
+    if (*slot == SWAP_ERROR) {
+      *slot = swap_page_out(kpage);
+    } else {
+      swap_ref(*slot);
+    }
+    spte->swap_index = *slot;
+    spte->status = ON_SWAP;
+    spte->kpage = NULL;
+    spte->dirty = is_dirty;
+  }
+}
+
+/* Frees the swap slot that SPTE's page was read from, if it
+   still has one, because the page has been written since. */
+static void page_drop_swap_copy(struct page_entry *spte) {
+  if (spte->swap_index != SWAP_ERROR) {
+    swap_release(spte->swap_index);
+    spte->swap_index = SWAP_ERROR;
+  }
+}
+
+/* Resolves a write fault on UPAGE that hit a read-only mapping.
+   If UPAGE is a copy-on-write page or maps the zero page, gives
+   the process its own writable copy and returns true.  Returns
+   false if the write is not allowed. */
+bool vm_page_cow(struct supplemental_page_table *supt_, uint32_t *pagedir, void *upage) {
+  struct page_table *supt = page_table_of(supt_);
+  struct page_entry *spte = supplemental_page_lookup(supt, upage);
+  void *kpage;
+
+  if (spte != NULL && spte->status == ALL_ZERO && spte->kpage != NULL) {
+    return page_load(supt, pagedir, upage, false);
+  }
+  if (spte == NULL || !spte->cow) {
+    return false;
+  }
+  kpage = spte->kpage;
+  if (kpage == NULL) {
+    /* Evicted meanwhile; retrying the write brings it back in. */
+    return true;
+  }
+  kpage = frame_cow(kpage, upage);
+  if (kpage == NULL) {
+    /* If the page was evicted meanwhile, retrying the write
+       brings it back in, writable. */
+    return spte->status != ON_FRAME;
+  }
+
+  pagedir_clear_page(pagedir, upage);
+  if (!pagedir_set_page(pagedir, upage, kpage, true)) {
+    frame_release_pinned(kpage);
+    return false;
+  }
+  spte->kpage = kpage;
+  spte->cow = false;
+  vm_frame_eviction_select(kpage);
+  return true;
+}
+
+/* Fills DST and DST_PD, the still empty address space of the
+   current thread, with a copy of SRC and SRC_PD for fork().
+   Resident pages are shared: writable ones are made read-only
+   on both sides and marked copy-on-write.  Swapped-out pages get
+   a swap slot of their own.  Pages of SRC_EXEC, the parent's
+   executable, are redirected to DST_EXEC.  mmap()ed pages are
+   left out.  Returns false if out of memory. */
+bool supplemental_table_fork(struct supplemental_page_table *dst_, uint32_t *dst_pd,
+    struct supplemental_page_table *src_, uint32_t *src_pd,
+    struct file *src_exec, struct file *dst_exec) {
+  struct page_table *dst = page_table_of(dst_), *src = page_table_of(src_);
+  struct hash_iterator i;
+  struct list_elem *e;
+  bool success = true;
+
+  /* Keep the parent's frames where they are while we look. */
+  frame_lock_eviction();
+  hash_first(&i, &src->page_map);
+  while (success && hash_next(&i)) {
+    struct page_entry *spte = hash_entry(hash_cur(&i), struct page_entry, elem);
+    struct page_entry *copy;
+
+    if (spte->is_mmap) {
+      continue;
+    }
+    copy = kmem_cache_alloc(&spte_cache);
+    if (copy == NULL) {
+      success = false;
+      break;
+    }
+    *copy = *spte;
+    if (copy->file == src_exec) {
+      copy->file = dst_exec;
+    }
+
+    if (spte->status == ALL_ZERO) {
+      /* The child maps the zero page on its own first read. */
+      copy->kpage = NULL;
+    } else if (spte->status == ON_FRAME) {
+      void *upage = spte->upage, *kpage = spte->kpage;
+
+      if (pagedir_is_dirty(src_pd, upage) || pagedir_is_dirty(src_pd, kpage)) {
+        spte->dirty = true;
+        page_drop_swap_copy(spte);
+      }
+      copy->dirty = spte->dirty;
+      copy->swap_index = SWAP_ERROR;
+      if (spte->writable) {
+        pagedir_clear_page(src_pd, upage);
+        if (!pagedir_set_page(src_pd, upage, kpage, false)) {
+          /* Give the parent its writable mapping back. */
+          pagedir_set_page(src_pd, upage, kpage, true);
+          kmem_cache_free(&spte_cache, copy);
+          success = false;
+          break;
+        }
+        spte->cow = copy->cow = true;
+      }
+      success = pagedir_set_page(dst_pd, upage, kpage, false)
+                && frame_map_add(kpage, upage);
+      if (!success) {
+        /* Not in DST yet; forget it entirely. */
+        pagedir_clear_page(dst_pd, upage);
+        kmem_cache_free(&spte_cache, copy);
+        break;
+      }
+      frame_set_page(kpage, copy);
+    } else if (spte->status == ON_SWAP) {
+      copy->swap_index = swap_page_dup(spte->swap_index);
+      if (copy->swap_index == SWAP_ERROR) {
+        kmem_cache_free(&spte_cache, copy);
+        success = false;
+        break;
+      }
+    }
+    hash_insert(&dst->page_map, &copy->elem);
+  }
+  frame_unlock_eviction();
+
+  /* Pages the parent never touched are still only in its VMAs. */
+  for (e = list_begin(&src->vmas); success && e != list_end(&src->vmas); e = list_next(e)) {
+    struct vma *vma = list_entry(e, struct vma, elem), *vcopy;
+
+    if (vma->is_mmap) {
+      continue;
+    }
+    vcopy = malloc(sizeof *vcopy);
+    if (vcopy == NULL) {
+      success = false;
+      break;
+    }
+    *vcopy = *vma;
+    if (vcopy->file == src_exec) {
+      vcopy->file = dst_exec;
+    }
+    list_push_back(&dst->vmas, &vcopy->elem);
+  }
+  return success;
+}
+
 #define WRITE_AT_FILE(f, page, bytes, offset) \
     do { \
         if (file_write_at(f, page, bytes, offset) != bytes) { \
@@ -405,7 +946,7 @@ bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage) {
 void handle_on_frame(struct page_entry *spte, uint32_t *pagedir, struct file *f, off_t offset, size_t bytes) {
     ASSERT(spte->kpage != NULL);
     CHECK_AND_WRITE(f, pagedir, spte, spte->upage, bytes, offset);
-    frame_release(spte->kpage);
+    frame_release_pinned(spte->kpage);
     pagedir_clear_page(pagedir, spte->upage);
 }
 
@@ -438,10 +979,9 @@ bool supplemental_page_unmap(struct page_table *supt, uint32_t *pagedir,
         PANIC("munmap - some page is missing. Unavailable situation");
     }
 
-    if (spte->status == ON_FRAME) {
-        ASSERT(spte->kpage != NULL);
-        vm_frame_pin_toggle(spte->kpage);
-    }
+    /* If the page is evicted before the pin holds, it is written
+       back and handled below wherever it went. */
+    page_pin_frame(spte);
 
     switch (spte->status) {
         case ON_FRAME:
@@ -461,6 +1001,7 @@ bool supplemental_page_unmap(struct page_table *supt, uint32_t *pagedir,
     }
 
     hash_delete(&supt->page_map, &spte->elem);
+    kmem_cache_free(&spte_cache, spte);
     return true;
 }
 
@@ -489,15 +1030,37 @@ static bool vm_page_load_from_filesys(struct page_entry *spte, void *kpage) {
     return true;
 }
 
-void vm_page_pin(struct page_table *supt, void *page) {
-    struct page_entry *spte;
-    spte = supplemental_page_lookup(supt, page);
-    if (spte == NULL) {
-        return;
+/* Pins the frame SPTE's page is in.  Returns false if the page
+   is not in a frame, or is evicted before the pin takes hold. */
+static bool page_pin_frame(struct page_entry *spte) {
+    void *kpage = spte->kpage;
+
+    if (spte->status != ON_FRAME || kpage == NULL || !vm_frame_pin_toggle(kpage)) {
+        return false;
     }
+    /* The frame may have been given to another of our pages. */
+    if (spte->status == ON_FRAME && spte->kpage == kpage) {
+        return true;
+    }
+    vm_frame_eviction_select(kpage);
+    return false;
+}
 
-    ASSERT(spte->status == ON_FRAME);
-    vm_frame_pin_toggle(spte->kpage);
+/* Loads PAGE and pins its frame.  The page-out thread may evict
+   the page between the two, so this loops until the pin holds.
+   Returns false if PAGE cannot be loaded. */
+bool vm_page_pin(struct page_table *supt, uint32_t *pagedir, void *page) {
+    for (;;) {
+        struct page_entry *spte;
+
+        if (!page_load(supt, pagedir, page, false)) {
+            return false;
+        }
+        spte = supplemental_page_lookup(supt, page);
+        if (spte != NULL && page_pin_frame(spte)) {
+            return true;
+        }
+    }
 }
 
 void vm_page_unpin(struct page_table *supt, void *page) {
@@ -531,13 +1094,24 @@ spte_destroy_func(struct hash_elem *elem, void *aux UNUSED) {
     return;
   }
   struct page_entry *entry = hash_entry(elem, struct page_entry, elem);
-  if (entry->kpage != NULL) {
-    ASSERT (entry->status == ON_FRAME);
-    frame_remove_entry (entry->kpage);
+  /* The page-out thread may be evicting the page right now, and
+     clears kpage and changes status when it is done.  Read kpage
+     only once, and look at status only after frame_remove_entry()
+     has waited for the eviction. */
+  void *kpage = entry->kpage;
+  if (kpage == zero_page) {
+    /* Keep pagedir_destroy() from freeing the zero page. */
+    pagedir_clear_page (thread_current ()->pagedir, entry->upage);
+  }
+  else if (kpage != NULL) {
+    frame_remove_entry (kpage);
+    ASSERT (entry->status != ALL_ZERO);
   }
-  else if(entry->status == ON_SWAP) {
+  /* A page in a frame may still have its swap slot, and an
+     evicted one now has one. */
+  if (entry->swap_index != SWAP_ERROR) {
     swap_release (entry->swap_index);
   }
 
-  free (entry);
+  kmem_cache_free (&spte_cache, entry);
 }
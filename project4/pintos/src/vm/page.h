@@ -3,6 +3,7 @@
 
 #include "vm/swap.h"
 #include <hash.h>
+#include <list.h>
 #include "filesys/off_t.h"
 
 enum page_status {
@@ -12,15 +13,23 @@ enum page_status {
   FROM_FILESYS      
 };
 
+/* threads/thread.h declares a process's table as a struct
+   supplemental_page_table, which is really a struct page_table.
+   Functions called from outside vm/ take it as declared there. */
+struct supplemental_page_table;
+
 struct page_table
   {
     struct hash page_map;
+    struct list vmas;         /* Lazily mapped ranges, by address. */
+    void *fault_next;         /* Page just past the last fault-around. */
+    size_t fault_window;      /* Pages to load ahead on the next fault. */
   };
 
 struct page_entry
   {
     void *upage;              
-    void *kpage;            
+    void *kpage;              /* Frame, or the zero page if ALL_ZERO. */
     struct hash_elem elem;
     enum page_status status;
     bool dirty;           
@@ -29,8 +38,11 @@ struct page_entry
     off_t file_offset;
     uint32_t read_bytes, zero_bytes;
     bool writable;
+    bool is_mmap;             /* FILE is mmap()ed: write back to it, not swap. */
+    bool cow;                 /* Shared with a fork()ed process until written. */
   };
 
+void vm_page_init (void);
 struct page_table*supplemental_table_create (void);
 void supplemental_table_destroy (struct page_table *);
 bool supplemental_frame_install (struct page_table *supt, void *upage, void *kpage);
@@ -38,13 +50,26 @@ bool supplemental_zeropage_install (struct page_table *supt, void *);
 bool supplemental_swap_configure (struct page_table *supt, void *, swap_index_t);
 bool supplemental_filesys_install (struct page_table *supt, void *page,
     struct file * file, off_t offset, uint32_t read_bytes, uint32_t zero_bytes, bool writable);
+bool supplemental_mmap_install (struct page_table *supt, void *page,
+    struct file * file, off_t offset, uint32_t read_bytes, uint32_t zero_bytes);
+bool supplemental_vma_install (struct supplemental_page_table *supt, void *start,
+    struct file *file, off_t offset, uint32_t read_bytes, uint32_t zero_bytes,
+    bool writable, bool is_mmap);
+void supplemental_vma_remove (struct supplemental_page_table *supt, void *start);
 struct page_entry* supplemental_page_lookup (struct page_table *supt, void *);
 bool supplemental_entry_exist (struct page_table *, void *page);
 bool supplemental_dirty_set (struct page_table *supt, void *, bool);
 bool vm_page_load(struct page_table *supt, uint32_t *pagedir, void *upage);
+bool vm_page_fault(struct supplemental_page_table *supt, uint32_t *pagedir, void *upage, bool write);
+void vm_page_print_stats(void);
+void vm_page_evict(struct page_entry *spte, uint32_t *pagedir, void *kpage, swap_index_t *slot);
+bool vm_page_cow(struct supplemental_page_table *supt, uint32_t *pagedir, void *upage);
+bool supplemental_table_fork(struct supplemental_page_table *dst, uint32_t *dst_pd,
+    struct supplemental_page_table *src, uint32_t *src_pd,
+    struct file *src_exec, struct file *dst_exec);
 bool supplemental_page_unmap(struct page_table *supt, uint32_t *pagedir,
     void *page, struct file *f, off_t offset, size_t bytes);
-void vm_page_pin(struct page_table *supt, void *page);
+bool vm_page_pin(struct page_table *supt, uint32_t *pagedir, void *page);
 void vm_page_unpin(struct page_table *supt, void *page);
 
 #endif
@@ -1,11 +1,30 @@
 #include <bitmap.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "devices/block.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
+
+/* Indexes with SWAP_ZBIT set name a slot of the compressed swap
+   arena rather than a slot on the swap device. */
+#define SWAP_ZBIT ((swap_index_t) 1 << 31)
+
 static const size_t SECTORS_PER_PAGE_COUNT = PGSIZE / BLOCK_SECTOR_SIZE;
 static size_t swap_block_count;
 static struct block *swap_device;
 static struct bitmap *swap_bitmap;
+static size_t swap_cursor;      /* Where to look for the next free slot. */
+
+/* References to each slot beyond the first.  A page evicted from
+   a frame that several processes share copy-on-write is written
+   once, and every process refers to the same slot. */
+static uint16_t *swap_refs;
+
+/* Protects swap_bitmap, swap_cursor and swap_refs.  Not held
+   during I/O, so that several pages can be swapped at once. */
+static struct lock swap_lock;
 
 
 void swap_initialize() {
@@ -32,16 +51,27 @@ void swap_initialize() {
         swap_block_count = block_size(swap_device) / SECTORS_PER_PAGE_COUNT;
         swap_bitmap = bitmap_create(swap_block_count);
         bitmap_set_all(swap_bitmap, true);
+        swap_refs = calloc(swap_block_count, sizeof *swap_refs);
+        if (swap_refs == NULL) {
+          PANIC("Error: Can't allocate swap reference counts");
+        }
+        lock_init(&swap_lock);
+        zswap_init();
         state = 99;
         break;
     }
   }
 }
 
-void swap_page_in(swap_index_t swap_index, void *page) {
+/* Reads the page in slot SWAP_INDEX into PAGE.  The slot stays
+   in use, so that it still holds a copy of the page. */
+void swap_page_read(swap_index_t swap_index, void *page) {
   int state = 0;
-  size_t sector;
 
+  if (swap_index & SWAP_ZBIT) {
+    zswap_load(swap_index & ~SWAP_ZBIT, page);
+    return;
+  }
   while (state != 99) {
     switch (state) {
       case 0:
@@ -60,42 +90,53 @@ void swap_page_in(swap_index_t swap_index, void *page) {
         break;
 
       case 2:
-        for (sector = 0; sector < SECTORS_PER_PAGE_COUNT; ++sector) {
-          block_read(swap_device,
-                     swap_index * SECTORS_PER_PAGE_COUNT + sector,
-                     page + (BLOCK_SECTOR_SIZE * sector));
-        }
-        bitmap_set(swap_bitmap, swap_index, true);
+        block_read_multiple(swap_device, swap_index * SECTORS_PER_PAGE_COUNT,
+                            page, SECTORS_PER_PAGE_COUNT);
         state = 99;
         break;
     }
   }
 }
 
+/* Reads the page in slot SWAP_INDEX into PAGE and frees the
+   slot. */
+void swap_page_in(swap_index_t swap_index, void *page) {
+  swap_page_read(swap_index, page);
+  swap_release(swap_index);
+}
+
+/* Saves PAGE to swap and returns where it went: to the
+   compressed arena if it compresses well and there is room,
+   otherwise to the swap device. */
 swap_index_t swap_page_out(void *page) {
   int state = 0;
   size_t swap_index = -1;
-  size_t sector;
 
+  if (zswap_store(page, &swap_index)) {
+    return swap_index | SWAP_ZBIT;
+  }
   while (state != 99) {
     switch (state) {
       case 0:
         ASSERT(page >= PHYS_BASE);
-        swap_index = bitmap_scan(swap_bitmap, 0, 1, true);
+        /* Take the next free slot after the last one handed out,
+           so that pages evicted together land next to each other.
+           The slot is marked used before it is written, since
+           other threads may be swapping out at the same time. */
+        lock_acquire(&swap_lock);
+        swap_index = bitmap_scan_and_flip(swap_bitmap, swap_cursor, 1, true);
+        if (swap_index == BITMAP_ERROR)
+          swap_index = bitmap_scan_and_flip(swap_bitmap, 0, 1, true);
+        if (swap_index == BITMAP_ERROR)
+          PANIC("Error: Swap is full");
+        swap_cursor = swap_index + 1;
+        lock_release(&swap_lock);
         state = 1;
         break;
 
       case 1:
-        for (sector = 0; sector < SECTORS_PER_PAGE_COUNT; ++sector) {
-          block_write(swap_device,
-                      swap_index * SECTORS_PER_PAGE_COUNT + sector,
-                      page + (BLOCK_SECTOR_SIZE * sector));
-        }
-        state = 2;
-        break;
-
-      case 2:
-        bitmap_set(swap_bitmap, swap_index, false);
+        block_write_multiple(swap_device, swap_index * SECTORS_PER_PAGE_COUNT,
+                             page, SECTORS_PER_PAGE_COUNT);
         state = 99;
         break;
     }
@@ -104,9 +145,29 @@ swap_index_t swap_page_out(void *page) {
   return swap_index;
 }
 
+/* Adds a reference to slot SWAP_INDEX, which then takes one more
+   swap_release() to free. */
+void swap_ref(swap_index_t swap_index) {
+  if (swap_index & SWAP_ZBIT) {
+    zswap_ref(swap_index & ~SWAP_ZBIT);
+    return;
+  }
+  ASSERT(swap_index < swap_block_count);
+  lock_acquire(&swap_lock);
+  ASSERT(!bitmap_test(swap_bitmap, swap_index));
+  swap_refs[swap_index]++;
+  lock_release(&swap_lock);
+}
+
+/* Drops a reference to slot SWAP_INDEX, freeing the slot when it
+   was the last. */
 void swap_release(swap_index_t swap_index) {
   int state = 0;
 
+  if (swap_index & SWAP_ZBIT) {
+    zswap_free(swap_index & ~SWAP_ZBIT);
+    return;
+  }
   while (state != 99) {
     switch (state) {
       case 0:
@@ -124,9 +185,31 @@ void swap_release(swap_index_t swap_index) {
         break;
 
       case 2:
-        bitmap_set(swap_bitmap, swap_index, true);
+        lock_acquire(&swap_lock);
+        if (swap_refs[swap_index] > 0) {
+          swap_refs[swap_index]--;
+        } else {
+          bitmap_set(swap_bitmap, swap_index, true);
+        }
+        lock_release(&swap_lock);
         state = 99;
         break;
     }
   }
 }
+
+/* Copies the page in slot SWAP_INDEX, which stays in use, to a
+   new slot and returns that slot, or SWAP_ERROR if no memory is
+   left to copy through. */
+swap_index_t swap_page_dup(swap_index_t swap_index) {
+  swap_index_t copy;
+  void *page;
+
+  page = palloc_get_page(0);
+  if (page == NULL)
+    return SWAP_ERROR;
+  swap_page_read(swap_index, page);
+  copy = swap_page_out(page);
+  palloc_free_page(page);
+  return copy;
+}
@@ -1,10 +1,14 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 typedef uint32_t swap_index_t;
+#define SWAP_ERROR ((swap_index_t) -1)
 
 void swap_initialize (void);
 void swap_page_in (swap_index_t swap_index, void *page);
+void swap_page_read (swap_index_t swap_index, void *page);
 swap_index_t swap_page_out (void *page);
+void swap_ref (swap_index_t swap_index);
 void swap_release (swap_index_t swap_index);
+swap_index_t swap_page_dup (swap_index_t swap_index);
 #endif 
 
@@ -0,0 +1,259 @@
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/zswap.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed swap.  swap_page_out() first offers each page
+   here.  A page that compresses to at most ZSWAP_MAX_SIZE bytes
+   is kept in an arena of kernel pool pages, in a run of
+   ZSWAP_CHUNK-byte chunks, and only pages that don't compress
+   or don't fit go to the swap device.  Swapping a page in from
+   the arena costs a decompression instead of disk I/O.
+
+   Pages are compressed with a small LZ77 coder.  The compressed
+   form is a sequence of items, each starting with a control
+   byte C:
+
+     - C < 0x80: C + 1 literal bytes follow.
+
+     - C >= 0x80: copy (C & 0x7f) + MATCH_MIN bytes from OFS
+       bytes back in the output, where OFS follows as 2 bytes,
+       least significant first.  The copy may overlap the bytes
+       it produces, so a run of one byte value is a literal and
+       then a few copies.
+
+   Matches are found through a hash table of the last position
+   at which each 3-byte sequence was seen. */
+
+#define ZSWAP_ARENA_PAGES 32            /* Size of the arena. */
+#define ZSWAP_CHUNK 64                  /* Unit of arena allocation. */
+#define ZSWAP_SLOT_CNT 512              /* Most pages in the arena. */
+#define ZSWAP_MAX_SIZE (PGSIZE / 2)     /* Largest page worth keeping. */
+
+#define LITERAL_MAX 128                 /* Longest literal run. */
+#define MATCH_MIN 3                     /* Shortest match. */
+#define MATCH_MAX (MATCH_MIN + 0x7f)    /* Longest match. */
+#define HASH_BITS 10
+
+/* A compressed page in the arena. */
+struct zswap_slot
+  {
+    uint16_t chunk;                     /* First chunk. */
+    uint16_t size;                      /* Compressed size in bytes. */
+    uint16_t refs;                      /* References beyond the first. */
+  };
+
+static uint8_t *arena;
+static struct bitmap *chunk_map;        /* Chunks in use. */
+static struct bitmap *slot_map;         /* Slots in use. */
+static struct zswap_slot slots[ZSWAP_SLOT_CNT];
+
+/* Protects the maps and the compressor's buffers. */
+static struct lock zswap_lock;
+static uint8_t zbuf[ZSWAP_MAX_SIZE];
+static uint16_t hash_head[1 << HASH_BITS];
+
+static long long store_cnt;             /* Pages kept compressed. */
+static long long spill_cnt;             /* Pages passed on to disk. */
+
+static size_t compress (const uint8_t *src, uint8_t *dst, size_t limit);
+static void decompress (const uint8_t *src, size_t size, uint8_t *dst);
+
+/* Sets up the arena.  If the kernel pool can't spare it, every
+   page goes to the swap device. */
+void zswap_init (void) {
+  size_t chunk_cnt = ZSWAP_ARENA_PAGES * PGSIZE / ZSWAP_CHUNK;
+
+  lock_init (&zswap_lock);
+  arena = palloc_get_multiple (0, ZSWAP_ARENA_PAGES);
+  chunk_map = bitmap_create (chunk_cnt);
+  slot_map = bitmap_create (ZSWAP_SLOT_CNT);
+  if (arena == NULL || chunk_map == NULL || slot_map == NULL) {
+    printf ("zswap: no memory for arena, swapping to disk only\n");
+    if (arena != NULL)
+      palloc_free_multiple (arena, ZSWAP_ARENA_PAGES);
+    arena = NULL;
+  }
+}
+
+/* Compresses PAGE into the arena.  Returns true and stores the
+   slot that holds it into *SLOT if successful; returns false if
+   PAGE doesn't compress well enough or the arena is full. */
+bool zswap_store (const void *page, size_t *slot) {
+  size_t size, chunk, s;
+
+  if (arena == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  size = compress (page, zbuf, ZSWAP_MAX_SIZE);
+  if (size == 0)
+    goto spill;
+  chunk = bitmap_scan_and_flip (chunk_map, 0,
+                                DIV_ROUND_UP (size, ZSWAP_CHUNK), false);
+  if (chunk == BITMAP_ERROR)
+    goto spill;
+  s = bitmap_scan_and_flip (slot_map, 0, 1, false);
+  if (s == BITMAP_ERROR) {
+    bitmap_set_multiple (chunk_map, chunk,
+                         DIV_ROUND_UP (size, ZSWAP_CHUNK), false);
+    goto spill;
+  }
+  memcpy (arena + chunk * ZSWAP_CHUNK, zbuf, size);
+  slots[s].chunk = chunk;
+  slots[s].size = size;
+  slots[s].refs = 0;
+  store_cnt++;
+  lock_release (&zswap_lock);
+
+  *slot = s;
+  return true;
+
+ spill:
+  spill_cnt++;
+  lock_release (&zswap_lock);
+  return false;
+}
+
+/* Decompresses the page in SLOT into PAGE.  SLOT stays in use.
+   SLOT is only freed once every holder of a reference to it has
+   let go, so its chunks can be read without the lock. */
+void zswap_load (size_t slot, void *page) {
+  ASSERT (slot < ZSWAP_SLOT_CNT);
+  ASSERT (bitmap_test (slot_map, slot));
+
+  decompress (arena + slots[slot].chunk * ZSWAP_CHUNK, slots[slot].size,
+              page);
+}
+
+/* Adds a reference to SLOT, which then takes one more
+   zswap_free() to free. */
+void zswap_ref (size_t slot) {
+  ASSERT (slot < ZSWAP_SLOT_CNT);
+
+  lock_acquire (&zswap_lock);
+  ASSERT (bitmap_test (slot_map, slot));
+  slots[slot].refs++;
+  lock_release (&zswap_lock);
+}
+
+/* Drops a reference to SLOT.  Frees SLOT and its chunks when it
+   was the last. */
+void zswap_free (size_t slot) {
+  ASSERT (slot < ZSWAP_SLOT_CNT);
+
+  lock_acquire (&zswap_lock);
+  ASSERT (bitmap_test (slot_map, slot));
+  if (slots[slot].refs > 0) {
+    slots[slot].refs--;
+    lock_release (&zswap_lock);
+    return;
+  }
+  bitmap_set_multiple (chunk_map, slots[slot].chunk,
+                       DIV_ROUND_UP (slots[slot].size, ZSWAP_CHUNK), false);
+  bitmap_reset (slot_map, slot);
+  lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap statistics. */
+void zswap_print_stats (void) {
+  printf ("zswap: %lld pages compressed, %lld sent to disk\n",
+          store_cnt, spill_cnt);
+}
+
+/* Returns the hash table bucket for the 3 bytes at P. */
+static unsigned hash3 (const uint8_t *p) {
+  uint32_t v = p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Appends CNT literal bytes from SRC to DST, which holds *OUT
+   bytes and may hold LIMIT.  Returns false if they don't fit. */
+static bool emit_literals (const uint8_t *src, size_t cnt, uint8_t *dst,
+                           size_t *out, size_t limit) {
+  while (cnt > 0) {
+    size_t n = cnt < LITERAL_MAX ? cnt : LITERAL_MAX;
+
+    if (*out + 1 + n > limit)
+      return false;
+    dst[(*out)++] = n - 1;
+    memcpy (dst + *out, src, n);
+    *out += n;
+    src += n;
+    cnt -= n;
+  }
+  return true;
+}
+
+/* Compresses the page at SRC into DST and returns the size of
+   the result, or 0 if it would be larger than LIMIT bytes. */
+static size_t compress (const uint8_t *src, uint8_t *dst, size_t limit) {
+  size_t in = 0, lit = 0, out = 0;
+
+  memset (hash_head, 0, sizeof hash_head);
+  while (in + MATCH_MIN <= PGSIZE) {
+    unsigned h = hash3 (src + in);
+    size_t cand = hash_head[h];         /* Position + 1, or 0. */
+    size_t len = 0;
+
+    hash_head[h] = in + 1;
+    if (cand != 0) {
+      cand--;
+      while (len < MATCH_MAX && in + len < PGSIZE
+             && src[cand + len] == src[in + len])
+        len++;
+    }
+    if (len < MATCH_MIN) {
+      in++;
+      continue;
+    }
+
+    if (!emit_literals (src + lit, in - lit, dst, &out, limit)
+        || out + 3 > limit)
+      return 0;
+    dst[out++] = 0x80 | (len - MATCH_MIN);
+    dst[out++] = (in - cand) & 0xff;
+    dst[out++] = (in - cand) >> 8;
+    in += len;
+    lit = in;
+  }
+  if (!emit_literals (src + lit, PGSIZE - lit, dst, &out, limit))
+    return 0;
+  return out;
+}
+
+/* Decompresses the SIZE bytes at SRC, produced by compress(),
+   into the page at DST. */
+static void decompress (const uint8_t *src, size_t size, uint8_t *dst) {
+  size_t in = 0, out = 0;
+
+  while (in < size) {
+    uint8_t c = src[in++];
+
+    if (c < 0x80) {
+      size_t n = c + 1;
+
+      ASSERT (in + n <= size && out + n <= PGSIZE);
+      memcpy (dst + out, src + in, n);
+      in += n;
+      out += n;
+    } else {
+      size_t len = (c & 0x7f) + MATCH_MIN;
+      size_t ofs;
+
+      ASSERT (in + 2 <= size);
+      ofs = src[in] | (src[in + 1] << 8);
+      in += 2;
+      ASSERT (ofs > 0 && ofs <= out && out + len <= PGSIZE);
+      for (; len > 0; len--, out++)
+        dst[out] = dst[out - ofs];
+    }
+  }
+  ASSERT (out == PGSIZE);
+}
@@ -0,0 +1,14 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void zswap_init (void);
+bool zswap_store (const void *page, size_t *slot);
+void zswap_load (size_t slot, void *page);
+void zswap_ref (size_t slot);
+void zswap_free (size_t slot);
+void zswap_print_stats (void);
+
+#endif